@@ -2,6 +2,8 @@
 
 #include <structures/union_find.hpp>
 
+#include <algorithm>
+#include <cstdint>
 #include <limits>
 #include <cassert>
 #include <iostream>
@@ -14,9 +16,15 @@ namespace algorithms {
 
 using namespace std;
 
-void three_edge_connected_component_merges_dense(size_t node_count, size_t first_root, 
-    const function<void(size_t, const function<void(size_t)>&)>& for_each_connected_node,
-    const function<void(size_t, size_t)>& same_component) {
+/**
+ * Implementation of three_edge_connected_component_merges_dense(), templated
+ * on the unsigned integer type used for node numbers and DFS counters in the
+ * per-node records. The DFS is bound by memory bandwidth, so using the
+ * smallest type that fits the node count lets more of the graph fit in cache.
+ */
+template<typename number_t>
+static void three_edge_connected_component_merges_dense_impl(const vector<size_t>& edge_offsets, const vector<size_t>& edge_targets,
+    size_t first_root, const function<void(size_t, size_t)>& same_component) {
     
     // Independent implementation of Norouzi and Tsin (2014) "A simple 3-edge
     // connected component algorithm revisited", which can't really be
@@ -54,48 +62,60 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
     // path without being on that path. To support those cases, we also give
     // each node a flag for whether it is on its own path.
     
-    // TODO: should we template this on an integer size so we can fit more work
-    // in less memory bandwidth when possible?
-    using number_t = size_t;
-    assert(node_count < numeric_limits<number_t>::max());
+    // There's a past-the-end offset after the last node's edges.
+    size_t node_count = edge_offsets.size() - 1;
+    
+    // DFS counters run up to node_count + 1, and the max value is reserved
+    // to mean no node.
+    assert(node_count < numeric_limits<number_t>::max() - 1);
+    // Effective degrees are sums of degrees of absorbed nodes, so they are
+    // bounded by the number of edge endpoints.
+    assert(edge_targets.size() < (numeric_limits<number_t>::max() - 1) / 2);
    
-    /// This defines the data we track for each node in the graph
-    struct TsinNode {
+    /// This defines the data we track for the nodes in the graph. Each field
+    /// is kept in its own array, indexed by node number, so that the parts of
+    /// the algorithm that only look at some fields don't have to pull the
+    /// others through the cache.
+    struct TsinNodes {
+        /// Allocate records for all the nodes, unvisited.
+        TsinNodes(size_t node_count) : dfs_counter(node_count), dfs_exit(node_count), low_point(node_count),
+            effective_degree(node_count, 0), path_tail(node_count), is_on_path(node_count), visited(node_count, false) {
+            // Nothing to do!
+        }
+        
         /// When in the DFS were we first visited?
-        number_t dfs_counter;
+        vector<number_t> dfs_counter;
         /// When in the DFS were we last visited?
         /// Needed for finding replacement neighbors to implement path range
         /// absorption in part 1.3, when we're asked for a range to a neighbor
         /// that got eaten.
-        number_t dfs_exit;
+        vector<number_t> dfs_exit;
         /// What is our "low point" in the search. This is the earliest
         /// dfs_counter for a node that this node or any node in its DFS
         /// subtree has a back-edge to.
-        number_t low_point;
+        vector<number_t> low_point;
         /// What is the effective degree of this node in the graph with all the
         /// absorb-eject modifications applied?
-        number_t effective_degree = 0;
+        vector<number_t> effective_degree;
         /// What node has the continuation of this node's path? If equal to
         /// numeric_limits<number_t>::max(), the path ends after here.
         /// The node's path is the path from this node, into its DFS subtree,
         /// to (one of) the nodes in the subtree that has the back-edge that
         /// caused this node's low point to be so low. Basically a low point
         /// traceback.
-        number_t path_tail;
+        vector<number_t> path_tail;
         /// Is this node actually on its own path?
         /// Nodes can be removed from their paths if those nodes don't matter
         /// any more (i.e. got absorbed) but their paths still need to be tails
         /// for other paths.
-        bool is_on_path;
-        /// Has the node been visited yet? Must be 0. TODO: Move to its own
-        /// vector to make zeroing them all free-ish with page table
-        /// shenanigans.
-        bool visited = false;
+        vector<bool> is_on_path;
+        /// Has the node been visited yet? Kept as a bitvector, since it is
+        /// checked for every edge.
+        vector<bool> visited;
     };
     
-    // We need to have all the nodes pre-allocated, so node references don't
-    // invalidate when we follow edges.
-    vector<TsinNode> nodes(node_count);
+    // We need to have all the nodes pre-allocated.
+    TsinNodes nodes(node_count);
     
     // We need to say how to absorb-eject along a whole path.
     //
@@ -146,10 +166,7 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
                 break;
             }
             
-            // Find the node we are at
-            auto& here_node = nodes[here];
-            
-            if (here_node.is_on_path) {
+            if (nodes.is_on_path[here]) {
                 // We're actually on the path.
                 
 #ifdef debug
@@ -179,8 +196,8 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
                     
                     // Update the effective degrees as if we merged this node
                     // with the connected into node.
-                    nodes[into].effective_degree = (nodes[into].effective_degree +
-                                                    here_node.effective_degree - 2);
+                    nodes.effective_degree[into] = (nodes.effective_degree[into] +
+                                                    nodes.effective_degree[here] - 2);
 
                     // Merge us into the same 3 edge connected component
                     same_component(into, here);
@@ -188,7 +205,7 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
             }
             
             // Advance to the tail of the path
-            here = here_node.path_tail;
+            here = nodes.path_tail[here];
             
 #ifdef debug
             cerr << "(\t\tNext: " << here << ")" << endl;
@@ -209,8 +226,8 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
         number_t here = node;
         bool first = true;
         while (here != numeric_limits<number_t>::max()) {
-            if (nodes[here].is_on_path) {
-                if (first && nodes[here].path_tail == numeric_limits<number_t>::max()) {
+            if (nodes.is_on_path[here]) {
+                if (first && nodes.path_tail[here] == numeric_limits<number_t>::max()) {
                     // Just a single node, no edge
                     s << "(just " << here << ")";
                     break;    
@@ -223,7 +240,7 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
                 }
                 s << here;
             }
-            here = nodes[here].path_tail;
+            here = nodes.path_tail[here];
         }
         
         return s.str();
@@ -234,9 +251,11 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
     struct DFSStackFrame {
         /// Track the node that this stack frame represents
         number_t current;
-        /// Track all the neighbors left to visit.
-        /// When we visit a neighbor we pop it off the back.
-        vector<number_t> neighbors;
+        /// Track the neighbors left to visit, as a cursor just past the next
+        /// one in edge_targets. We visit neighbors from the end of the node's
+        /// range back to the start, and move the cursor back as we finish
+        /// each. When it reaches the start of the range, we are done.
+        size_t edges_left;
         /// When we look at the neighbors, we need to be able to tell the tree
         /// edge to the parent from further back edges to the parent. So we
         /// have a flag for whether we have seen the parent tree edge already,
@@ -266,7 +285,7 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
     
     while (next_unvisited != node_count) {
         // We haven't visited everything yet.
-        if (!nodes[first_root].visited) {
+        if (!nodes.visited[first_root]) {
             // If possible start at the suggested root
             stack.emplace_back();
             stack.back().current = first_root;
@@ -286,13 +305,13 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
             // Note that this reference will be invalidated if we add stuff to the stack!
             auto& frame = stack.back();
             // And the current node
-            auto& node = nodes[frame.current];
+            number_t current = frame.current;
             
-            if (!node.visited) {
+            if (!nodes.visited[current]) {
                 // This is the first time we are in this stack frame. We need
                 // to do the initial visit of the node and set up the frame
                 // with the list of edges to do.
-                node.visited = true;
+                nodes.visited[current] = true;
                 
 #ifdef debug
                 cerr << "First visit of node " << frame.current << endl;
@@ -303,30 +322,28 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
                     // we just visited what it used to be.
                     do {
                         next_unvisited++;
-                    } while (next_unvisited != node_count && nodes[next_unvisited].visited);
+                    } while (next_unvisited != node_count && nodes.visited[next_unvisited]);
                 }
                 
-                node.dfs_counter = dfs_counter;
+                nodes.dfs_counter[current] = dfs_counter;
                 dfs_counter++;
-                node.low_point = node.dfs_counter;
+                nodes.low_point[current] = nodes.dfs_counter[current];
                 // Make sure the node's path is just itself
-                node.path_tail = numeric_limits<number_t>::max();
-                node.is_on_path = true;
+                nodes.path_tail[current] = numeric_limits<number_t>::max();
+                nodes.is_on_path[current] = true;
                 
 #ifdef debug
-                cerr << "\tDFS: " << node.dfs_counter
-                    << " low point: " << node.low_point
-                    << " degree: " << node.effective_degree
+                cerr << "\tDFS: " << nodes.dfs_counter[current]
+                    << " low point: " << nodes.low_point[current]
+                    << " degree: " << nodes.effective_degree[current]
                     << " path: " << path_to_string(frame.current) << endl;
 #endif
                 
-                // Stack up all the edges to follow.
-                for_each_connected_node(frame.current, [&](size_t connected) {
-                    frame.neighbors.push_back(connected);
-                });
+                // Point to all the edges to follow.
+                frame.edges_left = edge_offsets[frame.current + 1];
                 
 #ifdef debug
-                cerr << "\tPut " << frame.neighbors.size() << " edges on to do list" << endl;
+                cerr << "\tPut " << (edge_offsets[frame.current + 1] - edge_offsets[frame.current]) << " edges on to do list" << endl;
 #endif
                 
                 // Now we're in a state where we can process edges.
@@ -334,21 +351,20 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
                 continue;
             } else {
                 // We have (possibly 0) edges left to do for this node.
-                if (!frame.neighbors.empty()) {
+                if (frame.edges_left != edge_offsets[frame.current]) {
                 
 #ifdef debug
                     cerr << "Return to node " << frame.current << " with more edges to do" << endl;
                 
-                    cerr << "\tDFS: " << node.dfs_counter
-                        << " low point: " << node.low_point
-                        << " degree: " << node.effective_degree
+                    cerr << "\tDFS: " << nodes.dfs_counter[current]
+                        << " low point: " << nodes.low_point[current]
+                        << " degree: " << nodes.effective_degree[current]
                         << " path: " << path_to_string(frame.current) << endl;
 #endif
                 
                     // We have an edge to do!
                     // Look up the neighboring node.
-                    number_t neighbor_number = frame.neighbors.back();
-                    auto& neighbor = nodes[neighbor_number];
+                    number_t neighbor_number = edge_targets[frame.edges_left - 1];
                     
                     if (!frame.recursing) {
                         // This is the first time we are thinking about this neighbor.
@@ -358,13 +374,13 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
 #endif
                     
                         // Increment degree of the node we're coming from
-                        node.effective_degree++;
+                        nodes.effective_degree[current]++;
                         
 #ifdef debug
-                        cerr << "\t\tBump degree to " << node.effective_degree << endl;
+                        cerr << "\t\tBump degree to " << nodes.effective_degree[current] << endl;
 #endif
                         
-                        if (!neighbor.visited) {
+                        if (!nodes.visited[neighbor_number]) {
                             // We need to recurse on this neighbor.
                             
 #ifdef debug
@@ -391,7 +407,7 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
                                 // For tree edges, since they aren't either kind of back edge, neither 1.2 nor 1.3 fires.
                                 // But the next edge to the parent will be a back edge.
                                 frame.saw_parent_tree_edge = true;
-                            } else if (neighbor.dfs_counter < node.dfs_counter) {
+                            } else if (nodes.dfs_counter[neighbor_number] < nodes.dfs_counter[current]) {
                                 // The edge to the neighbor is an outgoing
                                 // back-edge (i.e. the neighbor was visited
                                 // first). Paper step 1.2.
@@ -400,12 +416,12 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
                                 cerr << "\t\tNeighbor is upstream of us (outgoing back edge)." << endl;
 #endif
                                 
-                                if (neighbor.dfs_counter < node.low_point) {
+                                if (nodes.dfs_counter[neighbor_number] < nodes.low_point[current]) {
                                     // The neighbor is below our low point.
                                     
 #ifdef debug
                                     cerr << "\t\t\tNeighbor has a lower low point ("
-                                        << neighbor.dfs_counter << " < " << node.low_point << ")" << endl;
+                                        << nodes.dfs_counter[neighbor_number] << " < " << nodes.low_point[current] << ")" << endl;
                                     
                                     cerr << "\t\t\t\tAbsorb along path to old low point source" << endl;
 #endif
@@ -417,15 +433,15 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
                                     
                                     // Adopt the neighbor's DFS counter as our
                                     // new, lower low point.
-                                    node.low_point = neighbor.dfs_counter;
+                                    nodes.low_point[current] = nodes.dfs_counter[neighbor_number];
 
 #ifdef debug
-                                    cerr << "\t\t\t\tNew lower low point " << node.low_point << endl;
+                                    cerr << "\t\t\t\tNew lower low point " << nodes.low_point[current] << endl;
 #endif
                                     
                                     // Our path is now just us.
-                                    node.is_on_path = true;
-                                    node.path_tail = numeric_limits<number_t>::max();
+                                    nodes.is_on_path[current] = true;
+                                    nodes.path_tail[current] = numeric_limits<number_t>::max();
                                     
 #ifdef debug
                                     cerr << "\t\t\t\tNew path " << path_to_string(frame.current) << endl;
@@ -438,7 +454,7 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
 #endif
                                 
                                 }
-                            } else if (node.dfs_counter < neighbor.dfs_counter) {
+                            } else if (nodes.dfs_counter[current] < nodes.dfs_counter[neighbor_number]) {
                                 // The edge to the neighbor is an incoming
                                 // back-edge (i.e. we were visited first, but
                                 // we recursed into something that got us to
@@ -450,10 +466,10 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
                                 
                                 // Drop our effective degree by 2 (I think
                                 // we're closing a cycle or something?)
-                                node.effective_degree -= 2;
+                                nodes.effective_degree[current] -= 2;
 
 #ifdef debug
-                                cerr << "\t\t\tDrop degree to " << node.effective_degree << endl;
+                                cerr << "\t\t\tDrop degree to " << nodes.effective_degree[current] << endl;
                                 
                                 cerr << "\t\t\tWant to absorb along path towards low point source through neighbor" << endl;
 #endif
@@ -494,17 +510,16 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
                                 // Start out with ourselves as the replacement neighbor ancestor.
                                 number_t replacement_neighbor_number = frame.current;
                                 // Consider the next candidate
-                                number_t candidate = nodes[replacement_neighbor_number].path_tail;
+                                number_t candidate = nodes.path_tail[replacement_neighbor_number];
                                 while (candidate != numeric_limits<number_t>::max() &&
-                                    nodes[candidate].dfs_counter <= neighbor.dfs_counter &&
-                                    nodes[candidate].dfs_exit >= neighbor.dfs_exit) {
+                                    nodes.dfs_counter[candidate] <= nodes.dfs_counter[neighbor_number] &&
+                                    nodes.dfs_exit[candidate] >= nodes.dfs_exit[neighbor_number]) {
                                     
                                     // This candidate is a lower ancestor of the neighbor, so adopt it.
                                     replacement_neighbor_number = candidate;
-                                    candidate = nodes[replacement_neighbor_number].path_tail;
+                                    candidate = nodes.path_tail[replacement_neighbor_number];
                                 }
                                 
-                                auto& replacement_neighbor = nodes[replacement_neighbor_number];
                                 
 #ifdef debug
                                 cerr << "\t\t\tNeighbor currently belongs to node " << replacement_neighbor_number << endl;
@@ -517,7 +532,7 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
                                 // Ignores trivial paths.
                                 absorb_all_along_path(numeric_limits<number_t>::max(),
                                                       frame.current,
-                                                      replacement_neighbor.path_tail);
+                                                      nodes.path_tail[replacement_neighbor_number]);
                                                       
                                 // We also have to (or at least can) adopt the
                                 // path of the replacement neighbor as our own
@@ -532,7 +547,7 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
                                 // If we ever merge us down our path again,
                                 // continue with the part we didn't already
                                 // eat.
-                                node.path_tail = replacement_neighbor.path_tail;
+                                nodes.path_tail[current] = nodes.path_tail[replacement_neighbor_number];
                             } else {
                                 // The other possibility is the neighbor is just
                                 // us. Officially self loops aren't allowed, so
@@ -542,12 +557,12 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
                                 cerr << "\t\tWe are neighbor (self loop). Hide edge!" << endl;
 #endif
 
-                                node.effective_degree--;
+                                nodes.effective_degree[current]--;
                             }
                             
                             // Clean up the neighbor from the to do list; we
                             // finished it without recursing.
-                            frame.neighbors.pop_back();
+                            frame.edges_left--;
                             
                             // Kick back to the work loop to do the next
                             // neighbor, if any.
@@ -564,22 +579,22 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
                         // 2014 as written in the paper assumes no bridge
                         // edges, and what we're about to do relies on all
                         // neighbors connecting back somewhere.
-                        if (neighbor.low_point == neighbor.dfs_counter) {
+                        if (nodes.low_point[neighbor_number] == nodes.dfs_counter[neighbor_number]) {
                             // It has no back-edges out of its own subtree, so it must be across a bridge.
 #ifdef debug
                             cerr << "\t\tNeighbor is across a bridge edge! Hide edge!" << endl;
 #endif
                             
                             // Hide the edge we just took from degree calculations.
-                            neighbor.effective_degree--;
-                            node.effective_degree--;
+                            nodes.effective_degree[neighbor_number]--;
+                            nodes.effective_degree[current]--;
                             
                             // Don't do anything else with the edge
                         } else {
                             // Wasn't a bridge edge, so we care about more than just traversing that part of the graph.
                             
                             // Do steps 1.1.1 and 1.1.2 of the algorithm as described in the paper.
-                            if (neighbor.effective_degree == 2) {
+                            if (nodes.effective_degree[neighbor_number] == 2) {
                                 // This neighbor gets absorbed and possibly ejected.
                                 
 #ifdef debug
@@ -589,7 +604,7 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
 #endif
                                 
                                 // Take it off of its own path.
-                                neighbor.is_on_path = false;
+                                nodes.is_on_path[neighbor_number] = false;
                                 
 #ifdef debug
                                 cerr << "\t\t\tNew neighbor path: " << path_to_string(neighbor_number) << endl;
@@ -597,9 +612,9 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
                             }
                             
                             // Because we hid the bridge edges, degree 1 nodes should never happen
-                            assert(neighbor.effective_degree != 1);
+                            assert(nodes.effective_degree[neighbor_number] != 1);
                             
-                            if (node.low_point <= neighbor.low_point) {
+                            if (nodes.low_point[current] <= nodes.low_point[neighbor_number]) {
 
 #ifdef debug
                                 cerr << "\t\tWe have a sufficiently low low point; neighbor comes back in in our subtree" << endl;
@@ -616,14 +631,14 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
                             } else {
 #ifdef debug
                                 cerr << "\t\tNeighbor has a lower low point ("
-                                    << neighbor.low_point << " < " <<  node.low_point << "); comes back in outside our subtree" << endl;
+                                    << nodes.low_point[neighbor_number] << " < " <<  nodes.low_point[current] << "); comes back in outside our subtree" << endl;
 #endif
                                 
                                 // Lower our low point to that of the neighbor
-                                node.low_point = neighbor.low_point;
+                                nodes.low_point[current] = nodes.low_point[neighbor_number];
                                 
 #ifdef debug
-                                cerr << "\t\t\tNew low point: " << node.low_point << endl;
+                                cerr << "\t\t\tNew low point: " << nodes.low_point[current] << endl;
                                 
                                 cerr << "\t\t\tAbsorb along path to old low point soure" << endl;
 #endif
@@ -633,8 +648,8 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
                                                       frame.current,
                                                       numeric_limits<number_t>::max());
                                 // Adjust our path to be us and then our neighbor's path
-                                node.is_on_path = true;
-                                node.path_tail = neighbor_number;
+                                nodes.is_on_path[current] = true;
+                                nodes.path_tail[current] = neighbor_number;
                                 
 #ifdef debug
                                 cerr << "\t\t\tNew path " << path_to_string(frame.current) << endl;
@@ -647,16 +662,16 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
                         frame.recursing = false;
                         
                         // Clean up the neighbor, 
-                        frame.neighbors.pop_back();
+                        frame.edges_left--;
                         
                         // Kick back to the work loop to do the next neighbor,
                         // if any.
                     }
                     
 #ifdef debug
-                    cerr << "\tDFS: " << node.dfs_counter
-                        << " low point: " << node.low_point
-                        << " degree: " << node.effective_degree
+                    cerr << "\tDFS: " << nodes.dfs_counter[current]
+                        << " low point: " << nodes.low_point[current]
+                        << " degree: " << nodes.effective_degree[current]
                         << " path: " << path_to_string(frame.current) << endl;
 #endif
                     
@@ -666,16 +681,16 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
 #ifdef debug
                     cerr << "\tNode is visited and no neighbors are on the to do list." << endl;
                     
-                    cerr << "\tDFS: " << node.dfs_counter
-                        << " low point: " << node.low_point
-                        << " degree: " << node.effective_degree
+                    cerr << "\tDFS: " << nodes.dfs_counter[current]
+                        << " low point: " << nodes.low_point[current]
+                        << " degree: " << nodes.effective_degree[current]
                         << " path: " << path_to_string(frame.current) << endl;
 #endif
                     
                     // This node is done.
                     
                     // Remember when we exited it
-                    node.dfs_exit = dfs_counter;
+                    nodes.dfs_exit[current] = dfs_counter;
                     
                     // Clean up the stack frame.
                     stack.pop_back();
@@ -688,15 +703,290 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
     // completed out search through all connected components of the graph.
 }
 
+void three_edge_connected_component_merges_dense(const vector<size_t>& edge_offsets, const vector<size_t>& edge_targets,
+    size_t first_root, const function<void(size_t, size_t)>& same_component) {
+    
+    assert(!edge_offsets.empty());
+    // Node numbers and DFS counters are bounded by the node count, but
+    // effective degrees add up as nodes are absorbed, and are only bounded by
+    // the number of edge endpoints. We also need to keep the max value free.
+    const size_t limit = numeric_limits<uint32_t>::max() - 1;
+    if (edge_offsets.size() - 1 < limit && edge_targets.size() < limit / 2) {
+        // Almost every graph fits in 32-bit numbers, which halves the size of
+        // each node's record.
+        three_edge_connected_component_merges_dense_impl<uint32_t>(edge_offsets, edge_targets, first_root, same_component);
+    } else {
+        three_edge_connected_component_merges_dense_impl<size_t>(edge_offsets, edge_targets, first_root, same_component);
+    }
+}
+
+void three_edge_connected_component_merges_dense_parallel(const vector<size_t>& edge_offsets, const vector<size_t>& edge_targets,
+    size_t first_root, const function<void(size_t, size_t)>& same_component) {
+    
+    // Two nodes that are 3-edge-connected are also 2-edge-connected, and any
+    // set of edge-disjoint paths between them stays inside their
+    // 2-edge-connected component, since leaving it means crossing a bridge
+    // both ways. So we can cut the graph at its bridges and find the
+    // 3-edge-connected components of each piece independently.
+    
+    assert(!edge_offsets.empty());
+    size_t node_count = edge_offsets.size() - 1;
+    
+    // First find the bridges, with a DFS that tracks low points. Preorder
+    // numbers start at 1, so 0 means unvisited.
+    vector<size_t> preorder(node_count, 0);
+    vector<size_t> low_point(node_count);
+    // DFS tree parent for each node, or numeric_limits<size_t>::max() for roots
+    vector<size_t> parent(node_count, numeric_limits<size_t>::max());
+    // Whether the tree edge from each node's parent is a bridge
+    vector<bool> bridge_to_parent(node_count, false);
+    // Nodes in the order we first visited them
+    vector<size_t> visit_order;
+    visit_order.reserve(node_count);
+    
+    struct BridgeFrame {
+        /// The node this frame is for
+        size_t node;
+        /// The next edge to look at in edge_targets
+        size_t cursor;
+        /// Have we seen the tree edge back to the parent yet? Any other edges
+        /// to the parent are parallel edges, and count as back edges.
+        bool saw_parent_tree_edge;
+    };
+    vector<BridgeFrame> stack;
+    
+    for (size_t root = 0; root < node_count; root++) {
+        if (preorder[root]) {
+            continue;
+        }
+        visit_order.push_back(root);
+        preorder[root] = visit_order.size();
+        low_point[root] = preorder[root];
+        stack.push_back({root, edge_offsets[root], false});
+        
+        while (!stack.empty()) {
+            // Note that this reference will be invalidated if we add stuff to the stack!
+            auto& frame = stack.back();
+            if (frame.cursor != edge_offsets[frame.node + 1]) {
+                // Look at the next edge
+                size_t next = edge_targets[frame.cursor];
+                frame.cursor++;
+                if (!preorder[next]) {
+                    // Tree edge. Recurse.
+                    parent[next] = frame.node;
+                    visit_order.push_back(next);
+                    preorder[next] = visit_order.size();
+                    low_point[next] = preorder[next];
+                    stack.push_back({next, edge_offsets[next], false});
+                } else if (next == parent[frame.node] && !frame.saw_parent_tree_edge) {
+                    // This is the edge we took to get here.
+                    frame.saw_parent_tree_edge = true;
+                } else {
+                    // Back edge (or self loop, which can't lower anything).
+                    low_point[frame.node] = min(low_point[frame.node], preorder[next]);
+                }
+            } else {
+                // Done with this node. Report to the parent.
+                size_t done = frame.node;
+                stack.pop_back();
+                if (!stack.empty()) {
+                    size_t up = stack.back().node;
+                    low_point[up] = min(low_point[up], low_point[done]);
+                    if (low_point[done] > preorder[up]) {
+                        // Nothing under here reaches back above it.
+                        bridge_to_parent[done] = true;
+                    }
+                }
+            }
+        }
+    }
+    
+    // Number the 2-edge-connected components. Each starts at a DFS root or
+    // below a bridge, and everything else is with its parent.
+    vector<size_t> component_of(node_count);
+    vector<size_t> member_offsets(1, 0);
+    for (auto& node : visit_order) {
+        if (parent[node] == numeric_limits<size_t>::max() || bridge_to_parent[node]) {
+            component_of[node] = member_offsets.size() - 1;
+            member_offsets.push_back(0);
+        } else {
+            component_of[node] = component_of[parent[node]];
+        }
+        member_offsets[component_of[node] + 1]++;
+    }
+    preorder.clear();
+    preorder.shrink_to_fit();
+    low_point.clear();
+    low_point.shrink_to_fit();
+    parent.clear();
+    parent.shrink_to_fit();
+    visit_order.clear();
+    visit_order.shrink_to_fit();
+    
+    size_t component_count = member_offsets.size() - 1;
+    size_t largest_component = component_count == 0 ? 0 : *max_element(member_offsets.begin() + 1, member_offsets.end());
+    
+#ifdef debug
+    cerr << "Split " << node_count << " nodes into " << component_count << " 2-edge-connected components, the largest with "
+        << largest_component << " nodes" << endl;
+#endif
+    
+    if (largest_component * 10 >= node_count * 9) {
+        // Almost all the work is in one piece, so there's nothing to do in
+        // parallel. Don't pay to copy it out; just run on the whole graph.
+        component_of.clear();
+        component_of.shrink_to_fit();
+        member_offsets.clear();
+        member_offsets.shrink_to_fit();
+        three_edge_connected_component_merges_dense(edge_offsets, edge_targets, first_root, same_component);
+        return;
+    }
+    
+    // Lay out the members of each component, in node order, and remember
+    // where each node ends up.
+    for (size_t i = 1; i < member_offsets.size(); i++) {
+        member_offsets[i] += member_offsets[i - 1];
+    }
+    vector<size_t> members(node_count);
+    vector<size_t> member_index(node_count);
+    {
+        vector<size_t> cursors(member_offsets.begin(), member_offsets.end() - 1);
+        for (size_t node = 0; node < node_count; node++) {
+            size_t component = component_of[node];
+            member_index[node] = cursors[component];
+            members[cursors[component]] = node;
+            cursors[component]++;
+        }
+    }
+    
+    // Most graphs have lots of tiny pieces, which aren't worth a task, an
+    // adjacency, and a run of Tsin's algorithm each. So we batch runs of
+    // consecutive pieces together until they have at least this many nodes,
+    // and run on each batch as one graph, which Tsin's algorithm handles as
+    // several connected components. Pieces at least this big go alone.
+    const size_t BATCH_NODES = 16384;
+    // Each batch is a range of component numbers, and since members are laid
+    // out in component order, the members of a batch are contiguous.
+    vector<size_t> batch_starts(1, 0);
+    for (size_t component = 0; component < component_count; component++) {
+        size_t batch_size = member_offsets[component] - member_offsets[batch_starts.back()];
+        size_t component_size = member_offsets[component + 1] - member_offsets[component];
+        if (batch_size != 0 && (batch_size >= BATCH_NODES || component_size >= BATCH_NODES)) {
+            // Start a new batch here, so big components are alone
+            batch_starts.push_back(component);
+        }
+    }
+    batch_starts.push_back(component_count);
+    size_t batch_count = batch_starts.size() - 1;
+    
+#ifdef debug
+    cerr << "Process components in " << batch_count << " batches" << endl;
+#endif
+    
+    // Run Tsin's algorithm on each batch in parallel. The callback isn't
+    // necessarily thread safe, so we buffer each batch's merges.
+    vector<vector<pair<size_t, size_t>>> batch_merges(batch_count);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t batch = 0; batch < batch_count; batch++) {
+        size_t first_member = member_offsets[batch_starts[batch]];
+        size_t past_last_member = member_offsets[batch_starts[batch + 1]];
+        if (past_last_member - first_member == batch_starts[batch + 1] - batch_starts[batch]) {
+            // All the components are single nodes, which can't be merged
+            // with anything.
+            continue;
+        }
+        
+        // Make the adjacency for just this batch, in local numbers. Only
+        // bridges leave a component, so we drop those edges, and that keeps
+        // the batch's components separate.
+        vector<size_t> local_offsets;
+        vector<size_t> local_targets;
+        local_offsets.reserve(past_last_member - first_member + 1);
+        for (size_t i = first_member; i < past_last_member; i++) {
+            local_offsets.push_back(local_targets.size());
+            size_t node = members[i];
+            for (size_t j = edge_offsets[node]; j < edge_offsets[node + 1]; j++) {
+                if (component_of[edge_targets[j]] == component_of[node]) {
+                    local_targets.push_back(member_index[edge_targets[j]] - first_member);
+                }
+            }
+        }
+        local_offsets.push_back(local_targets.size());
+        
+        // Root at the suggested root if it is here.
+        size_t local_root = 0;
+        if (first_root < node_count && member_index[first_root] >= first_member && member_index[first_root] < past_last_member) {
+            local_root = member_index[first_root] - first_member;
+        }
+        
+        auto& merges = batch_merges[batch];
+        three_edge_connected_component_merges_dense(local_offsets, local_targets, local_root, [&](size_t a, size_t b) {
+            // Translate back to global numbers
+            merges.emplace_back(members[first_member + a], members[first_member + b]);
+        });
+    }
+    
+    // Report all the merges, in batch order.
+    for (auto& merges : batch_merges) {
+        for (auto& merge : merges) {
+            same_component(merge.first, merge.second);
+        }
+    }
+}
+
+/**
+ * Lay out all the edges of a graph with dense node numbers in a compressed
+ * sparse row adjacency structure, by calling for_each_connected_node on each
+ * node.
+ */
+static void make_adjacency(size_t node_count, const function<void(size_t, const function<void(size_t)>&)>& for_each_connected_node,
+    vector<size_t>& edge_offsets, vector<size_t>& edge_targets) {
+    
+    edge_offsets.clear();
+    edge_targets.clear();
+    edge_offsets.reserve(node_count + 1);
+    for (size_t i = 0; i < node_count; i++) {
+        edge_offsets.push_back(edge_targets.size());
+        for_each_connected_node(i, [&](size_t connected) {
+            edge_targets.push_back(connected);
+        });
+    }
+    edge_offsets.push_back(edge_targets.size());
+}
+
+void three_edge_connected_component_merges_dense(size_t node_count, size_t first_root, 
+    const function<void(size_t, const function<void(size_t)>&)>& for_each_connected_node,
+    const function<void(size_t, size_t)>& same_component) {
+    
+    // Lay out all the edges up front, so the DFS doesn't need to call back
+    // for them or keep them in each stack frame.
+    vector<size_t> edge_offsets;
+    vector<size_t> edge_targets;
+    make_adjacency(node_count, for_each_connected_node, edge_offsets, edge_targets);
+    
+    three_edge_connected_component_merges_dense(edge_offsets, edge_targets, first_root, same_component);
+}
+
 void three_edge_connected_components_dense(size_t node_count, size_t first_root,
     const function<void(size_t, const function<void(size_t)>&)>& for_each_connected_node,
     const function<void(const function<void(const function<void(size_t)>&)>&)>& component_callback) {
     
+    vector<size_t> edge_offsets;
+    vector<size_t> edge_targets;
+    make_adjacency(node_count, for_each_connected_node, edge_offsets, edge_targets);
+    
+    three_edge_connected_components_dense(edge_offsets, edge_targets, first_root, component_callback);
+}
+
+void three_edge_connected_components_dense(const vector<size_t>& edge_offsets, const vector<size_t>& edge_targets,
+    size_t first_root, const function<void(const function<void(const function<void(size_t)>&)>&)>& component_callback) {
+    
     // Make a union-find over all the nodes
-    structures::UnionFind uf(node_count, true);
+    assert(!edge_offsets.empty());
+    structures::UnionFind uf(edge_offsets.size() - 1, true);
     
     // Call Tsin's Algorithm
-    three_edge_connected_component_merges_dense(node_count, first_root, for_each_connected_node, [&](size_t a, size_t b) {
+    three_edge_connected_component_merges_dense(edge_offsets, edge_targets, first_root, [&](size_t a, size_t b) {
         // When it says to do a merge, do it
         uf.union_groups(a, b);
     });
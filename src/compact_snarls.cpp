@@ -0,0 +1,255 @@
+#include "snarls/compact_snarls.hpp"
+#include "snarls/snarl_manager.hpp"
+#include "snarls/snarl.hpp"
+
+#include <vg/io/protobuf_iterator.hpp>
+#include <vg/io/protobuf_emitter.hpp>
+
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+
+//#define debug
+
+namespace snarls {
+
+using namespace std;
+using namespace vg;
+using namespace handlegraph;
+
+/// Magic bytes, including a format version, at the start of a compact snarl stream
+static const char COMPACT_SNARLS_MAGIC[8] = {'S', 'N', 'R', 'L', 'C', 'M', 'P', 1};
+
+/// Write an unsigned integer as a little-endian base-128 varint
+static void write_varint(ostream& out, uint64_t value) {
+    char buffer[10];
+    size_t used = 0;
+    while (value >= 0x80) {
+        buffer[used++] = (char) ((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    buffer[used++] = (char) value;
+    out.write(buffer, used);
+}
+
+/// Read an unsigned little-endian base-128 varint
+static uint64_t read_varint(istream& in) {
+    uint64_t value = 0;
+    for (size_t shift = 0; shift < 64; shift += 7) {
+        int byte = in.get();
+        if (byte == EOF) {
+            throw runtime_error("Truncated compact snarl stream");
+        }
+        value |= ((uint64_t) (byte & 0x7F)) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+    throw runtime_error("Malformed varint in compact snarl stream");
+}
+
+/// Write a signed difference as a zigzag varint
+static void write_delta(ostream& out, nid_t from, nid_t to) {
+    int64_t delta = (int64_t) ((uint64_t) to - (uint64_t) from);
+    write_varint(out, ((uint64_t) delta << 1) ^ (uint64_t) (delta >> 63));
+}
+
+/// Read a signed difference as a zigzag varint, and apply it
+static nid_t read_delta(istream& in, nid_t from) {
+    uint64_t zigzag = read_varint(in);
+    uint64_t delta = (zigzag >> 1) ^ (~(zigzag & 1) + 1);
+    return (nid_t) ((uint64_t) from + delta);
+}
+
+CompactSnarlWriter::CompactSnarlWriter(ostream& out) : out(out) {
+    out.write(COMPACT_SNARLS_MAGIC, sizeof(COMPACT_SNARLS_MAGIC));
+    // Start at the top level, which can have any number of snarls
+    stack.push_back({numeric_limits<size_t>::max(), 0});
+}
+
+void CompactSnarlWriter::write(const Snarl& snarl, size_t child_count) {
+    if (snarl.type() < 0 || snarl.type() > 3) {
+        throw runtime_error("Cannot compactly encode snarl type " + std::to_string(snarl.type()));
+    }
+
+    // Pack all the flags
+    uint8_t flags = (uint8_t) snarl.type();
+    flags |= snarl.start().backward() << 2;
+    flags |= snarl.end().backward() << 3;
+    flags |= snarl.start_self_reachable() << 4;
+    flags |= snarl.end_self_reachable() << 5;
+    flags |= snarl.start_end_reachable() << 6;
+    flags |= snarl.directed_acyclic_net_graph() << 7;
+    out.put((char) flags);
+
+    write_varint(out, child_count);
+
+    Frame& parent = stack.back();
+    write_delta(out, parent.reference, snarl.start().node_id());
+    write_delta(out, snarl.start().node_id(), snarl.end().node_id());
+
+    // Later siblings are relative to our end
+    parent.reference = snarl.end().node_id();
+    parent.remaining--;
+
+    if (child_count != 0) {
+        // Our children come next, relative to our start
+        stack.push_back({child_count, snarl.start().node_id()});
+    } else {
+        while (stack.size() > 1 && stack.back().remaining == 0) {
+            // Finish off all the snarls we have written all the children of
+            stack.pop_back();
+        }
+    }
+}
+
+CompactSnarlReader::CompactSnarlReader(istream& in) : in(in) {
+    char magic[sizeof(COMPACT_SNARLS_MAGIC)];
+    in.read(magic, sizeof(magic));
+    if (!in || memcmp(magic, COMPACT_SNARLS_MAGIC, sizeof(magic)) != 0) {
+        throw runtime_error("Not a compact snarl stream");
+    }
+    stack.emplace_back();
+    stack.back().remaining = numeric_limits<size_t>::max();
+    stack.back().reference = 0;
+}
+
+bool CompactSnarlReader::read(Snarl& snarl) {
+    int flags = in.get();
+    if (flags == EOF) {
+        if (stack.size() > 1) {
+            throw runtime_error("Compact snarl stream ends before all child snarls are read");
+        }
+        return false;
+    }
+
+    size_t child_count = read_varint(in);
+
+    Frame& parent = stack.back();
+    nid_t start_id = read_delta(in, parent.reference);
+    nid_t end_id = read_delta(in, start_id);
+
+    snarl.Clear();
+    snarl.set_type((SnarlType) (flags & 0x3));
+    snarl.mutable_start()->set_node_id(start_id);
+    snarl.mutable_start()->set_backward(flags & 0x4);
+    snarl.mutable_end()->set_node_id(end_id);
+    snarl.mutable_end()->set_backward(flags & 0x8);
+    snarl.set_start_self_reachable(flags & 0x10);
+    snarl.set_end_self_reachable(flags & 0x20);
+    snarl.set_start_end_reachable(flags & 0x40);
+    snarl.set_directed_acyclic_net_graph(flags & 0x80);
+    if (stack.size() > 1) {
+        transfer_boundary_info(parent.parent, *snarl.mutable_parent());
+    }
+
+#ifdef debug
+    cerr << "Read compact snarl " << to_string(snarl) << " with " << child_count << " children" << endl;
+#endif
+
+    // Later siblings are relative to our end
+    parent.reference = end_id;
+    parent.remaining--;
+
+    if (child_count != 0) {
+        // Our children come next, relative to our start
+        stack.emplace_back();
+        stack.back().remaining = child_count;
+        stack.back().reference = start_id;
+        transfer_boundary_info(snarl, stack.back().parent);
+    } else {
+        while (stack.size() > 1 && stack.back().remaining == 0) {
+            // Finish off all the snarls we have read all the children of
+            stack.pop_back();
+        }
+    }
+
+    return true;
+}
+
+void write_compact_snarls(const SnarlManager& manager, ostream& out) {
+    CompactSnarlWriter writer(out);
+
+    // Go chain by chain, so the chains can be recovered from the order.
+    vector<const Snarl*> stack;
+    const deque<Chain>& root_chains = manager.chains_of(nullptr);
+    for (auto chain_it = root_chains.rbegin(); chain_it != root_chains.rend(); ++chain_it) {
+        for (auto it = chain_it->rbegin(); it != chain_it->rend(); ++it) {
+            stack.push_back(it->first);
+        }
+    }
+
+    while (!stack.empty()) {
+        const Snarl* snarl = stack.back();
+        stack.pop_back();
+
+        writer.write(*snarl, manager.children_of(snarl).size());
+
+        // Stack up the children so they come off in chain order
+        const deque<Chain>& child_chains = manager.chains_of(snarl);
+        for (auto chain_it = child_chains.rbegin(); chain_it != child_chains.rend(); ++chain_it) {
+            for (auto it = chain_it->rbegin(); it != chain_it->rend(); ++it) {
+                stack.push_back(it->first);
+            }
+        }
+    }
+}
+
+void for_each_compact_snarl(istream& in, const function<void(Snarl&)>& iteratee) {
+    CompactSnarlReader reader(in);
+    Snarl snarl;
+    while (reader.read(snarl)) {
+        iteratee(snarl);
+    }
+}
+
+void protobuf_to_compact_snarls(istream& in, ostream& out) {
+    // The Protobuf stream can be in any order, so we need to load the tree to
+    // put it in preorder.
+    vector<Snarl> all_snarls;
+    for (vg::io::ProtobufIterator<Snarl> iter(in); iter.has_current(); iter.advance()) {
+        all_snarls.emplace_back(std::move(*iter));
+    }
+
+    // Find each snarl by how you read into it
+    unordered_map<pair<nid_t, bool>, size_t> snarl_into;
+    snarl_into.reserve(all_snarls.size());
+    for (size_t i = 0; i < all_snarls.size(); i++) {
+        snarl_into[make_pair(all_snarls[i].start().node_id(), all_snarls[i].start().backward())] = i;
+    }
+
+    // Work out the children of each snarl, in stream order
+    vector<vector<size_t>> children(all_snarls.size());
+    vector<size_t> roots;
+    for (size_t i = 0; i < all_snarls.size(); i++) {
+        if (all_snarls[i].has_parent()) {
+            auto found = snarl_into.find(make_pair(all_snarls[i].parent().start().node_id(), all_snarls[i].parent().start().backward()));
+            if (found == snarl_into.end()) {
+                throw runtime_error("Unable to find parent of snarl " + to_string(all_snarls[i]));
+            }
+            children[found->second].push_back(i);
+        } else {
+            roots.push_back(i);
+        }
+    }
+
+    CompactSnarlWriter writer(out);
+    vector<size_t> stack(roots.rbegin(), roots.rend());
+    while (!stack.empty()) {
+        size_t here = stack.back();
+        stack.pop_back();
+
+        writer.write(all_snarls[here], children[here].size());
+        stack.insert(stack.end(), children[here].rbegin(), children[here].rend());
+    }
+}
+
+void compact_to_protobuf_snarls(istream& in, ostream& out) {
+    vg::io::ProtobufEmitter<Snarl> emitter(out);
+    for_each_compact_snarl(in, [&](Snarl& snarl) {
+        emitter.write_copy(snarl);
+    });
+}
+
+}
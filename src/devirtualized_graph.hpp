@@ -0,0 +1,174 @@
+#ifndef LIBSNARLS_DEVIRTUALIZED_GRAPH_HPP_INCLUDED
+#define LIBSNARLS_DEVIRTUALIZED_GRAPH_HPP_INCLUDED
+
+#include <handlegraph/handle_graph.hpp>
+
+#include <bdsg/packed_graph.hpp>
+#include <bdsg/hash_graph.hpp>
+
+#include <typeinfo>
+
+namespace snarls {
+
+using namespace std;
+using namespace handlegraph;
+
+/**
+ * A view of a HandleGraph of a known concrete type, which makes qualified
+ * calls to the concrete type's implementations of the basic handle accessors
+ * so the compiler can inline them instead of going through the vtable.
+ *
+ * Graph kernels can be written as templates over the view type, and then
+ * instantiated through with_devirtualized_graph().
+ *
+ * The graph must be exactly of the given type, and not a subclass of it, or
+ * the qualified calls would skip the subclass's overrides.
+ *
+ * This is a private header for the library's own sources, and isn't
+ * installed.
+ *
+ * follow_edges() still goes through the graph's std::function-based
+ * implementation, since that is the only way HandleGraph exposes it.
+ */
+template<typename Graph>
+class DevirtualizedGraph {
+public:
+    /// Make a view of the given graph
+    inline DevirtualizedGraph(const Graph& graph) : graph(graph) {
+        // Nothing to do!
+    }
+
+    inline handle_t get_handle(const nid_t& node_id, bool is_reverse = false) const {
+        return graph.Graph::get_handle(node_id, is_reverse);
+    }
+
+    inline nid_t get_id(const handle_t& handle) const {
+        return graph.Graph::get_id(handle);
+    }
+
+    inline bool get_is_reverse(const handle_t& handle) const {
+        return graph.Graph::get_is_reverse(handle);
+    }
+
+    inline handle_t flip(const handle_t& handle) const {
+        return graph.Graph::flip(handle);
+    }
+
+    inline edge_t edge_handle(const handle_t& left, const handle_t& right) const {
+        return graph.edge_handle(left, right);
+    }
+
+    template<typename Iteratee>
+    inline bool follow_edges(const handle_t& handle, bool go_left, const Iteratee& iteratee) const {
+        return graph.follow_edges(handle, go_left, iteratee);
+    }
+
+protected:
+    /// The graph we are a view of
+    const Graph& graph;
+};
+
+/**
+ * When the concrete graph type isn't known, we just make virtual calls.
+ */
+template<>
+class DevirtualizedGraph<HandleGraph> {
+public:
+    /// Make a view of the given graph
+    inline DevirtualizedGraph(const HandleGraph& graph) : graph(graph) {
+        // Nothing to do!
+    }
+
+    inline handle_t get_handle(const nid_t& node_id, bool is_reverse = false) const {
+        return graph.get_handle(node_id, is_reverse);
+    }
+
+    inline nid_t get_id(const handle_t& handle) const {
+        return graph.get_id(handle);
+    }
+
+    inline bool get_is_reverse(const handle_t& handle) const {
+        return graph.get_is_reverse(handle);
+    }
+
+    inline handle_t flip(const handle_t& handle) const {
+        return graph.flip(handle);
+    }
+
+    inline edge_t edge_handle(const handle_t& left, const handle_t& right) const {
+        return graph.edge_handle(left, right);
+    }
+
+    template<typename Iteratee>
+    inline bool follow_edges(const handle_t& handle, bool go_left, const Iteratee& iteratee) const {
+        return graph.follow_edges(handle, go_left, iteratee);
+    }
+
+protected:
+    /// The graph we are a view of
+    const HandleGraph& graph;
+};
+
+/**
+ * The concrete graph types that we can make specialized DevirtualizedGraph
+ * views of.
+ */
+enum class DevirtualizedGraphType : uint8_t {
+    PACKED,
+    HASHED,
+    OTHER
+};
+
+/**
+ * Work out what kind of DevirtualizedGraph view we can use for the given
+ * graph. We compare exact types, so subclasses of the graph types we know
+ * about, which might override their methods, get virtual calls.
+ */
+inline DevirtualizedGraphType devirtualized_graph_type(const HandleGraph& graph) {
+    if (typeid(graph) == typeid(bdsg::PackedGraph)) {
+        return DevirtualizedGraphType::PACKED;
+    }
+    if (typeid(graph) == typeid(bdsg::HashGraph)) {
+        return DevirtualizedGraphType::HASHED;
+    }
+    return DevirtualizedGraphType::OTHER;
+}
+
+/**
+ * Call the given generic callable with a DevirtualizedGraph view of the given
+ * graph, which must have the given type, as determined by
+ * devirtualized_graph_type(). Returns the result of the callable.
+ *
+ * Hot code can work out the type once, and then dispatch on it cheaply for
+ * each call.
+ */
+template<typename Callable>
+inline auto with_devirtualized_graph(const HandleGraph& graph, DevirtualizedGraphType type, const Callable& callable)
+    -> decltype(callable(DevirtualizedGraph<HandleGraph>(graph))) {
+    
+    switch (type) {
+    case DevirtualizedGraphType::PACKED:
+        return callable(DevirtualizedGraph<bdsg::PackedGraph>(static_cast<const bdsg::PackedGraph&>(graph)));
+    case DevirtualizedGraphType::HASHED:
+        return callable(DevirtualizedGraph<bdsg::HashGraph>(static_cast<const bdsg::HashGraph&>(graph)));
+    default:
+        return callable(DevirtualizedGraph<HandleGraph>(graph));
+    }
+}
+
+/**
+ * Call the given generic callable with a DevirtualizedGraph view of the given
+ * graph. If the graph is exactly one of the bdsg graph implementations we
+ * know about, the view will be specialized for it. Otherwise, the view will
+ * use virtual calls. Returns the result of the callable.
+ */
+template<typename Callable>
+inline auto with_devirtualized_graph(const HandleGraph& graph, const Callable& callable)
+    -> decltype(callable(DevirtualizedGraph<HandleGraph>(graph))) {
+    
+    return with_devirtualized_graph(graph, devirtualized_graph_type(graph), callable);
+}
+
+}
+
+#endif
@@ -54,6 +54,46 @@ void three_edge_connected_component_merges(const function<void(const function<vo
     const function<void(TECCNode, const function<void(TECCNode)>&)>& for_each_connected_node,
     const function<void(TECCNode, TECCNode)>& same_component);
 
+/**
+ * Versions of three_edge_connected_components() and
+ * three_edge_connected_component_merges() that take any callable types, so
+ * that calls to them, including the per-edge calls made by
+ * for_each_connected_node's iteratee, can be inlined. TECCNode must be given
+ * explicitly.
+ *
+ * Each callable is called with an iteratee that is a lambda and not a
+ * std::function, so a for_each_node or for_each_connected_node that takes its
+ * iteratee as a template parameter avoids indirect calls entirely. Callables
+ * written against the std::function signatures above still work.
+ */
+template<typename TECCNode, typename ForEachNode, typename ForEachConnectedNode, typename ComponentCallback>
+void three_edge_connected_components(const ForEachNode& for_each_node,
+    const ForEachConnectedNode& for_each_connected_node,
+    const ComponentCallback& component_callback);
+    
+template<typename TECCNode, typename ForEachNode, typename ForEachConnectedNode, typename SameComponent>
+void three_edge_connected_component_merges(const ForEachNode& for_each_node,
+    const ForEachConnectedNode& for_each_connected_node,
+    const SameComponent& same_component);
+
+/**
+ * Versions of three_edge_connected_components() and
+ * three_edge_connected_component_merges() for graphs where the caller can
+ * already rank the nodes. Instead of a function to loop over all nodes, takes
+ * the number of nodes, a function from each node to its dense, 0-based rank,
+ * and a function from each rank back to its node. No hash table of nodes is
+ * built. TECCNode must be given explicitly.
+ */
+template<typename TECCNode, typename RankOf, typename NodeAt, typename ForEachConnectedNode, typename ComponentCallback>
+void three_edge_connected_components(size_t node_count, const RankOf& rank_of, const NodeAt& node_at,
+    const ForEachConnectedNode& for_each_connected_node,
+    const ComponentCallback& component_callback);
+    
+template<typename TECCNode, typename RankOf, typename NodeAt, typename ForEachConnectedNode, typename SameComponent>
+void three_edge_connected_component_merges(size_t node_count, const RankOf& rank_of, const NodeAt& node_at,
+    const ForEachConnectedNode& for_each_connected_node,
+    const SameComponent& same_component);
+
 
 /**
  * Get the three-edge-connected components of an arbitrary graph (not
@@ -67,11 +107,49 @@ void three_edge_connected_component_merges(const function<void(const function<vo
  * the set of nodes in each component (not restricted to the input graph).
  * Doing merge operations on a union-find can get you the set of components.
  * The callback MUST NOT modify the graph!
+ *
+ * Lays out all the edges in a compressed sparse row adjacency structure
+ * before starting. If you already have one, use the overload that takes it.
  */
 void three_edge_connected_component_merges_dense(size_t node_count, size_t first_root,
     const function<void(size_t, const function<void(size_t)>&)>& for_each_connected_node,
     const function<void(size_t, size_t)>& same_component);
 
+/**
+ * Get the three-edge-connected components of an arbitrary graph (not
+ * necessarily a handle graph). Only recognizes one kind of edge and one kind
+ * of node. Nodes are dense positive integers starting with 0.
+ *
+ * Takes the graph as a compressed sparse row adjacency structure: the nodes
+ * connected to node i are edge_targets[edge_offsets[i]] up to but not
+ * including edge_targets[edge_offsets[i + 1]], and edge_offsets has a
+ * trailing past-the-end entry. Also takes a suggested root (or 0).
+ *
+ * Calls same_component with pairs of nodes in (at least) a spanning tree of
+ * the set of nodes in each component (not restricted to the input graph).
+ * Doing merge operations on a union-find can get you the set of components.
+ */
+void three_edge_connected_component_merges_dense(const vector<size_t>& edge_offsets, const vector<size_t>& edge_targets,
+    size_t first_root, const function<void(size_t, size_t)>& same_component);
+
+/**
+ * Get the three-edge-connected components of an arbitrary graph, given as a
+ * compressed sparse row adjacency structure, like
+ * three_edge_connected_component_merges_dense(). Every edge must appear in
+ * the adjacency of both of its ends, except self loops, which may appear
+ * once.
+ *
+ * Finds the bridge edges first, and then runs Tsin's algorithm on each
+ * 2-edge-connected component in parallel. Small components are batched
+ * together, and if one component has nearly the whole graph, it just runs the
+ * serial version. Produces the same components as the serial version, and
+ * calls same_component from the calling thread only.
+ *
+ * Needs memory for a second copy of the adjacency, split up by component.
+ */
+void three_edge_connected_component_merges_dense_parallel(const vector<size_t>& edge_offsets, const vector<size_t>& edge_targets,
+    size_t first_root, const function<void(size_t, size_t)>& same_component);
+
 /**
  * Get the three-edge-connected components of an arbitrary graph (not
  * necessarily a handle graph). Only recognizes one kind of edge and one kind
@@ -86,72 +164,140 @@ void three_edge_connected_component_merges_dense(size_t node_count, size_t first
 void three_edge_connected_components_dense(size_t node_count, size_t first_root, 
     const function<void(size_t, const function<void(size_t)>&)>& for_each_connected_node,
     const function<void(const function<void(const function<void(size_t)>&)>&)>& component_callback);
+
+/**
+ * Get the three-edge-connected components of an arbitrary graph, given as a
+ * compressed sparse row adjacency structure, like
+ * three_edge_connected_component_merges_dense().
+ *
+ * For each component identified, calls the given callback with a function that
+ * iterates over all nodes in the component.
+ */
+void three_edge_connected_components_dense(const vector<size_t>& edge_offsets, const vector<size_t>& edge_targets,
+    size_t first_root, const function<void(const function<void(const function<void(size_t)>&)>&)>& component_callback);
     
 // Implementation
 
-template<typename TECCNode>
-void three_edge_connected_components(const function<void(const function<void(TECCNode)>&)>& for_each_node,
-    const function<void(TECCNode, const function<void(TECCNode)>&)>& for_each_connected_node,
-    const function<void(const function<void(const function<void(TECCNode)>&)>&)>& component_callback) {
-    
-    // Convert to small positive integers
-    vector<TECCNode> rank_to_node;
-    unordered_map<TECCNode, size_t> node_to_rank;
+template<typename TECCNode, typename RankOf, typename NodeAt, typename ForEachConnectedNode, typename ComponentCallback>
+void three_edge_connected_components(size_t node_count, const RankOf& rank_of, const NodeAt& node_at,
+    const ForEachConnectedNode& for_each_connected_node,
+    const ComponentCallback& component_callback) {
     
-    for_each_node([&](TECCNode node) {
-        // Populate the rank/node translation.
-        // TODO: can we condense this?
-        node_to_rank[node] = rank_to_node.size();
-        rank_to_node.push_back(node);
-    });
-    
-    three_edge_connected_components_dense(rank_to_node.size(), 0, [&](size_t rank, const function<void(size_t)> visit_connected) {
-        // Translate the rank we are asked about into a node
-        for_each_connected_node(rank_to_node[rank], [&](TECCNode connected) {
-            // And translate the node back into a rank
-            visit_connected(node_to_rank[connected]);
+    // Lay out the edges by rank, so the algorithm doesn't need to call back
+    // for them.
+    vector<size_t> edge_offsets;
+    vector<size_t> edge_targets;
+    edge_offsets.reserve(node_count + 1);
+    for (size_t rank = 0; rank < node_count; rank++) {
+        edge_offsets.push_back(edge_targets.size());
+        for_each_connected_node(node_at(rank), [&](const TECCNode& connected) {
+            edge_targets.push_back(rank_of(connected));
         });
-    }, [&](const function<void(const function<void(size_t)>&)>& for_each_component_member) {
+    }
+    edge_offsets.push_back(edge_targets.size());
+    
+    three_edge_connected_components_dense(edge_offsets, edge_targets, 0, [&](const function<void(const function<void(size_t)>&)>& for_each_component_member) {
         // When we get a component
         // Call our component callback with a function that takes the iteratee
-        component_callback([&](const function<void(TECCNode)>& iteratee) {
+        component_callback([&](const auto& iteratee) {
             for_each_component_member([&](size_t member) {
                 // And for each member of the component we got, translate it and send it off.
-                iteratee(rank_to_node[member]);
+                iteratee(node_at(member));
             });
         });
     });
 }
 
-template<typename TECCNode>
-void three_edge_connected_component_merges(const function<void(const function<void(TECCNode)>&)>& for_each_node,
-    const function<void(TECCNode, const function<void(TECCNode)>&)>& for_each_connected_node,
-    const function<void(TECCNode, TECCNode)>& same_component) {
+template<typename TECCNode, typename RankOf, typename NodeAt, typename ForEachConnectedNode, typename SameComponent>
+void three_edge_connected_component_merges(size_t node_count, const RankOf& rank_of, const NodeAt& node_at,
+    const ForEachConnectedNode& for_each_connected_node,
+    const SameComponent& same_component) {
+    
+    // Lay out the edges by rank, so the algorithm doesn't need to call back
+    // for them.
+    vector<size_t> edge_offsets;
+    vector<size_t> edge_targets;
+    edge_offsets.reserve(node_count + 1);
+    for (size_t rank = 0; rank < node_count; rank++) {
+        edge_offsets.push_back(edge_targets.size());
+        for_each_connected_node(node_at(rank), [&](const TECCNode& connected) {
+            edge_targets.push_back(rank_of(connected));
+        });
+    }
+    edge_offsets.push_back(edge_targets.size());
+    
+    three_edge_connected_component_merges_dense(edge_offsets, edge_targets, 0, [&](size_t a, size_t b) {
+        // When we find out two nodes should be in the same component
+        // Call our merge callback
+        same_component(node_at(a), node_at(b));
+    });
+}
+
+template<typename TECCNode, typename ForEachNode, typename ForEachConnectedNode, typename ComponentCallback>
+void three_edge_connected_components(const ForEachNode& for_each_node,
+    const ForEachConnectedNode& for_each_connected_node,
+    const ComponentCallback& component_callback) {
     
     // Convert to small positive integers
     vector<TECCNode> rank_to_node;
     unordered_map<TECCNode, size_t> node_to_rank;
     
-    for_each_node([&](TECCNode node) {
+    for_each_node([&](const TECCNode& node) {
         // Populate the rank/node translation.
-        // TODO: can we condense this?
         node_to_rank[node] = rank_to_node.size();
         rank_to_node.push_back(node);
     });
     
-    three_edge_connected_component_merges_dense(rank_to_node.size(), 0, [&](size_t rank, const function<void(size_t)> visit_connected) {
-        // Translate the rank we are asked about into a node
-        for_each_connected_node(rank_to_node[rank], [&](TECCNode connected) {
-            // And translate the node back into a rank
-            visit_connected(node_to_rank[connected]);
-        });
-    }, [&](size_t a, size_t b) {
-        // When we find out two nodes should be in the same component
-        // Call our merge callback
-        same_component(rank_to_node[a], rank_to_node[b]);
+    three_edge_connected_components<TECCNode>(rank_to_node.size(), [&](const TECCNode& node) {
+        return node_to_rank.at(node);
+    }, [&](size_t rank) {
+        return rank_to_node[rank];
+    }, for_each_connected_node, component_callback);
+}
+
+template<typename TECCNode, typename ForEachNode, typename ForEachConnectedNode, typename SameComponent>
+void three_edge_connected_component_merges(const ForEachNode& for_each_node,
+    const ForEachConnectedNode& for_each_connected_node,
+    const SameComponent& same_component) {
+    
+    // Convert to small positive integers
+    vector<TECCNode> rank_to_node;
+    unordered_map<TECCNode, size_t> node_to_rank;
+    
+    for_each_node([&](const TECCNode& node) {
+        // Populate the rank/node translation.
+        node_to_rank[node] = rank_to_node.size();
+        rank_to_node.push_back(node);
     });
+    
+    three_edge_connected_component_merges<TECCNode>(rank_to_node.size(), [&](const TECCNode& node) {
+        return node_to_rank.at(node);
+    }, [&](size_t rank) {
+        return rank_to_node[rank];
+    }, for_each_connected_node, same_component);
 }
 
+template<typename TECCNode>
+void three_edge_connected_components(const function<void(const function<void(TECCNode)>&)>& for_each_node,
+    const function<void(TECCNode, const function<void(TECCNode)>&)>& for_each_connected_node,
+    const function<void(const function<void(const function<void(TECCNode)>&)>&)>& component_callback) {
+    
+    // Use the version for any callable. We have to name all its template
+    // parameters, or we would pick this version again.
+    three_edge_connected_components<TECCNode, decltype(for_each_node), decltype(for_each_connected_node), decltype(component_callback)>(
+        for_each_node, for_each_connected_node, component_callback);
+}
+
+template<typename TECCNode>
+void three_edge_connected_component_merges(const function<void(const function<void(TECCNode)>&)>& for_each_node,
+    const function<void(TECCNode, const function<void(TECCNode)>&)>& for_each_connected_node,
+    const function<void(TECCNode, TECCNode)>& same_component) {
+    
+    // Use the version for any callable. We have to name all its template
+    // parameters, or we would pick this version again.
+    three_edge_connected_component_merges<TECCNode, decltype(for_each_node), decltype(for_each_connected_node), decltype(same_component)>(
+        for_each_node, for_each_connected_node, same_component);
+}
     
 }
 }
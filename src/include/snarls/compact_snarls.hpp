@@ -0,0 +1,119 @@
+#ifndef LIBSNARLS_COMPACT_SNARLS_HPP_INCLUDED
+#define LIBSNARLS_COMPACT_SNARLS_HPP_INCLUDED
+
+#include "snarls/vg_types.hpp"
+
+#include <handlegraph/types.hpp>
+
+#include <iostream>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+namespace snarls {
+
+using namespace std;
+using namespace vg;
+using namespace handlegraph;
+
+class SnarlManager;
+
+/*
+ * The compact snarl format is a small header followed by one record per
+ * snarl, in preorder over the snarl tree, with the children of each snarl
+ * right after it. Each record is:
+ *
+ * 1. A flags byte: the SnarlType in the low 2 bits, then the start and end
+ *    backward flags, then start_self_reachable, end_self_reachable,
+ *    start_end_reachable, and directed_acyclic_net_graph.
+ * 2. The number of child snarls, as a varint.
+ * 3. The start node ID, as a zigzag varint delta from the end node ID of the
+ *    previous sibling, or from the parent's start node ID if there is no
+ *    previous sibling, or from 0 for the very first snarl.
+ * 4. The end node ID, as a zigzag varint delta from the start node ID.
+ *
+ * Parents are implied by the nesting, and are not stored. When written from
+ * a SnarlManager, the children of each snarl are written chain by chain, so
+ * chains are also implicit in the ordering.
+ */
+
+/**
+ * Writes snarls in the compact format to a stream, as they are provided.
+ */
+class CompactSnarlWriter {
+public:
+    /// Make a writer that writes to the given stream, and write the header.
+    CompactSnarlWriter(ostream& out);
+
+    /// Write out a snarl. It must be the next snarl in preorder, and exactly
+    /// child_count child snarls must be written after it before any of its
+    /// later siblings. The snarl's parent field is ignored.
+    void write(const Snarl& snarl, size_t child_count);
+
+protected:
+    /// Stream we are writing to.
+    ostream& out;
+
+    /// Tracks a snarl whose children we are writing, or the top level
+    struct Frame {
+        /// How many more children are expected
+        size_t remaining;
+        /// The node ID that the next child's start is encoded relative to
+        nid_t reference;
+    };
+
+    /// The snarls we are in, with the top level at the bottom
+    vector<Frame> stack;
+};
+
+/**
+ * Reads snarls in the compact format from a stream, one at a time.
+ */
+class CompactSnarlReader {
+public:
+    /// Make a reader that reads from the given stream, and check the header.
+    CompactSnarlReader(istream& in);
+
+    /// Read the next snarl into the given Snarl, filling in the boundaries of
+    /// its parent, if any. Returns false, without modifying the snarl, if
+    /// there are no more snarls.
+    bool read(Snarl& snarl);
+
+protected:
+    /// Stream we are reading from.
+    istream& in;
+
+    /// Tracks a snarl whose children we are reading, or the top level
+    struct Frame {
+        /// How many more children are expected
+        size_t remaining;
+        /// The node ID that the next child's start is encoded relative to
+        nid_t reference;
+        /// The boundaries of the snarl, to use as the children's parent.
+        Snarl parent;
+    };
+
+    /// The snarls we are in, with the top level at the bottom
+    vector<Frame> stack;
+};
+
+/// Write all the snarls in a SnarlManager to the given stream in the compact
+/// format.
+void write_compact_snarls(const SnarlManager& manager, ostream& out);
+
+/// Call the given function with each snarl in the given compact format
+/// stream. Can be passed to the callback-based SnarlManager constructor.
+void for_each_compact_snarl(istream& in, const function<void(Snarl&)>& iteratee);
+
+/// Convert a stream of Protobuf Snarls, in any order, to the compact format.
+/// Snarl orientations and the order of children among their siblings are
+/// preserved.
+void protobuf_to_compact_snarls(istream& in, ostream& out);
+
+/// Convert a stream of snarls in the compact format to a stream of Protobuf
+/// Snarls, in preorder.
+void compact_to_protobuf_snarls(istream& in, ostream& out);
+
+}
+
+#endif
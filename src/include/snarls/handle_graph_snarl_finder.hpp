@@ -34,6 +34,16 @@ protected:
      */
     virtual SnarlManager find_snarls_unindexed();
     
+    /**
+     * Find all the snarls from the decomposition, and put them into a
+     * SnarlManager, but don't finish it.
+     *
+     * If classify is false, skip computing connectivity, acyclicity, and
+     * ultrabubble status. Snarls with the same start and end node are still
+     * marked UNARY, and all other snarls are left UNCLASSIFIED.
+     */
+    SnarlManager collect_snarls(bool classify);
+    
 public:
 
     /**
@@ -48,6 +58,13 @@ public:
      */
     virtual SnarlManager find_snarls();
     
+    /**
+     * Find all the snarls, and put them into a SnarlManager, computing only
+     * the snarl and chain nesting structure. Connectivity and acyclicity
+     * fields are left unset, and only unary snarls get a type.
+     */
+    SnarlManager find_snarls_unclassified();
+    
     /**
      * Visit all snarls and chains, including trivial snarls and single-node
      * empty chains.
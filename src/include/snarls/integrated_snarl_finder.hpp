@@ -47,17 +47,26 @@ private:
      */
     class MergedAdjacencyGraph;
     
+    /**
+     * Map from handles in the graph to values, stored by handle rank.
+     */
+    template<typename Value>
+    class DenseHandleMap;
+    
     /**
      * Find all the snarls, given the Cactus graph, the bridge forest, the
      * longest paths and cycles, and the towards-leaf/around-cycle information
      * needed to follow them.
+     *
+     * Connected components are decomposed in parallel, but their events are
+     * reported in order, one component at a time.
      */
     void traverse_computed_decomposition(MergedAdjacencyGraph& cactus,
         const MergedAdjacencyGraph& forest,
         vector<pair<size_t, vector<handle_t>>>& longest_paths,
-        unordered_map<handle_t, handle_t>& towards_deepest_leaf,
+        DenseHandleMap<handle_t>& towards_deepest_leaf,
         vector<pair<size_t, handle_t>>& longest_cycles,
-        unordered_map<handle_t, handle_t>& next_along_cycle,
+        DenseHandleMap<handle_t>& next_along_cycle,
         const function<void(handle_t)>& begin_chain, const function<void(handle_t)>& end_chain,
         const function<void(handle_t)>& begin_snarl, const function<void(handle_t)>& end_snarl) const;
     
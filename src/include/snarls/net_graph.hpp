@@ -166,6 +166,11 @@ public:
     /// chain or snarl (in either direction), get the handle in this graph used
     /// to represent that child chain or snarl in that orientation.
     handle_t get_handle_from_inward_backing_handle(const handle_t& backing_handle) const;
+    
+    /// Work out whether the given chain of child snarls, as a whole, is
+    /// left-left, right-right, and left-right connected, from the
+    /// connectivity of the snarls in it.
+    static tuple<bool, bool, bool> chain_connectivity(const Chain& chain);
         
 protected:
     
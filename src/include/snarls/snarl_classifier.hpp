@@ -0,0 +1,146 @@
+#ifndef LIBSNARLS_SNARL_CLASSIFIER_HPP_INCLUDED
+#define LIBSNARLS_SNARL_CLASSIFIER_HPP_INCLUDED
+
+#include "snarls/net_graph.hpp"
+#include "snarls/vg_types.hpp"
+
+#include <handlegraph/handle_graph.hpp>
+
+#include <vector>
+#include <unordered_map>
+
+namespace snarls {
+
+using namespace std;
+using namespace vg;
+using namespace handlegraph;
+
+/**
+ * Computes the connectivity, tip, acyclicity, and type information for snarls
+ * whose children have already been classified.
+ *
+ * Instead of building separate net graphs with and without internal
+ * connectivity and running generic algorithms over them, we enumerate a
+ * single flat net graph once into a local adjacency structure over oriented
+ * nodes. The internal connectivity edges of child chains and unary snarls are
+ * derived from the flat edges, and reachability, tips, and directed
+ * acyclicity are all computed on the local structure.
+ *
+ * Keeps its scratch space between snarls, so one classifier should be reused
+ * for many snarls. Not safe to use from multiple threads at once.
+ */
+class SnarlClassifier {
+public:
+
+    /// Make a classifier for snarls in the given graph, which must outlive it.
+    SnarlClassifier(const HandleGraph* graph);
+
+    /// Fill in the start_self_reachable, end_self_reachable,
+    /// start_end_reachable, directed_acyclic_net_graph, and type fields of
+    /// the given snarl, which has the given classified child chains. Unary
+    /// child snarls appear as chains of just themselves.
+    template<typename ChainContainer>
+    void classify(Snarl& snarl, const ChainContainer& child_chains);
+
+protected:
+
+    /// The graph the snarls are in
+    const HandleGraph* graph;
+
+    /// Flags for how the internal connectivity of an oriented local node
+    /// lets us leave its right side.
+    enum : uint8_t {
+        /// We can leave through the right side in the flat net graph
+        THROUGH = 1,
+        /// We can turn around and leave through the left side, reversed
+        TURN = 2
+    };
+
+    /// A child whose internal connectivity we need to apply once we have
+    /// enumerated the net graph.
+    struct ChildConnectivity {
+        /// Backing graph handle reading into the child
+        handle_t head;
+        /// Connectivity flags for the child read in that orientation
+        uint8_t forward_flags;
+        /// Connectivity flags for the child read in the other orientation
+        uint8_t reverse_flags;
+    };
+
+    /// Children registered for the snarl we are classifying
+    vector<ChildConnectivity> children;
+
+    /// Local index for each net graph node ID
+    unordered_map<nid_t, size_t> local_index;
+    /// Forward net graph handle for each local node
+    vector<handle_t> local_handles;
+    /// Start of each oriented local node's flat rightward edges in
+    /// edge_targets, with a trailing past-the-end entry. Oriented local node
+    /// 2 * i + is_reverse is local node i in that orientation.
+    vector<size_t> edge_offsets;
+    /// Oriented local nodes reached by flat rightward edges
+    vector<size_t> edge_targets;
+    /// Connectivity flags for each oriented local node
+    vector<uint8_t> connectivity;
+
+    /// Marks for searches over oriented local nodes
+    vector<uint8_t> marks;
+    /// Queue or stack of oriented local nodes, for searches
+    vector<size_t> queue;
+    /// Stack of oriented local nodes and edge cursors, for searches
+    vector<pair<size_t, size_t>> stack;
+
+    /// Remember the internal connectivity of a child chain.
+    void add_chain_child(const Chain& chain);
+
+    /// Remember the internal connectivity of a unary child snarl.
+    void add_unary_child(const Snarl* unary);
+
+    /// Classify the snarl with the given flat net graph, using the children
+    /// we have registered.
+    void classify_net_graph(Snarl& snarl, const NetGraph& flat_net_graph, bool all_ultrabubble_children);
+
+    /// Enumerate the given flat net graph into the local adjacency structure.
+    void materialize(const NetGraph& flat_net_graph);
+
+    /// Get the oriented local node for a net graph handle.
+    size_t to_local(const NetGraph& flat_net_graph, const handle_t& handle) const;
+
+    /// Find which of the given oriented local nodes are reachable from the
+    /// given oriented local node, using internal connectivity. Returns the
+    /// reachability of each target.
+    pair<bool, bool> reaches(size_t from, size_t target1, size_t target2);
+
+    /// Determine if the flat net graph has no directed cycles.
+    bool is_directed_acyclic();
+};
+
+template<typename ChainContainer>
+void SnarlClassifier::classify(Snarl& snarl, const ChainContainer& child_chains) {
+    children.clear();
+
+    bool all_ultrabubble_children = true;
+    for (auto& chain : child_chains) {
+        // Register each child the same way the NetGraph would see it
+        if (chain.size() == 1 && chain.front().first->type() == UNARY) {
+            add_unary_child(chain.front().first);
+        } else {
+            add_chain_child(chain);
+        }
+        for (auto& child : chain) {
+            if (child.first->type() != ULTRABUBBLE) {
+                all_ultrabubble_children = false;
+            }
+        }
+    }
+
+    // Make a net graph that just pretends child snarls/chains are ordinary
+    // nodes. We apply the internal connectivity ourselves.
+    NetGraph flat_net_graph(snarl.start(), snarl.end(), child_chains, graph);
+
+    classify_net_graph(snarl, flat_net_graph, all_ultrabubble_children);
+}
+
+}
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef LIBSNARLS_SNARL_FILE_INDEX_HPP_INCLUDED
+#define LIBSNARLS_SNARL_FILE_INDEX_HPP_INCLUDED
+
+#include <handlegraph/types.hpp>
+
+#include <iostream>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+namespace snarls {
+
+using namespace std;
+using namespace handlegraph;
+
+/**
+ * An index over a serialized snarl file, as written by
+ * SnarlManager::serialize(). Each top-level chain's snarls (and all their
+ * descendants) are written as one or more groups of their own, and for each
+ * group we record which top-level chain it belongs to, the range of snarl
+ * boundary node IDs mentioned by that chain, and the virtual offsets in the
+ * compressed file where it starts and ends. This lets readers seek right to
+ * the parts of the file that they want.
+ *
+ * Node ID ranges are per chain, not per group. The emitter splits large
+ * chains across several groups, and each of those groups gets the whole
+ * chain's range.
+ */
+class SnarlFileIndex {
+public:
+
+    /**
+     * Describes one group of snarls in the file.
+     */
+    struct Entry {
+        /// The number of the top-level chain, in serialization order, that
+        /// all the snarls in the group belong to.
+        size_t chain;
+        /// The smallest snarl boundary node ID mentioned anywhere in the
+        /// group's top-level chain.
+        nid_t min_id;
+        /// The largest snarl boundary node ID mentioned anywhere in the
+        /// group's top-level chain.
+        nid_t max_id;
+        /// The virtual offset of the start of the group.
+        int64_t start_vo;
+        /// The virtual offset just past the end of the group.
+        int64_t past_end_vo;
+    };
+
+    /// Make an empty index.
+    SnarlFileIndex() = default;
+
+    /// Load an index from the given stream.
+    SnarlFileIndex(istream& in);
+
+    /// Record a group in the index. Groups must be added in file order.
+    void add_group(size_t chain, nid_t min_id, nid_t max_id, int64_t start_vo, int64_t past_end_vo);
+
+    /// Get all the groups, in file order.
+    const vector<Entry>& groups() const;
+
+    /// Get the number of top-level chains in the file.
+    size_t chain_count() const;
+
+    /// Call the given function with each group, in file order, that belongs
+    /// to one of the top-level chains with numbers in the given sorted
+    /// vector.
+    void for_each_group_in_chains(const vector<size_t>& chains, const function<void(const Entry&)>& iteratee) const;
+
+    /// Call the given function with each group, in file order, whose
+    /// top-level chain mentions snarl boundary node IDs overlapping the given
+    /// inclusive range. Since all the groups for a chain are reported if any
+    /// are, the snarls overlapping the range will all be reached, along with
+    /// their ancestors.
+    void for_each_group_overlapping(nid_t min_id, nid_t max_id, const function<void(const Entry&)>& iteratee) const;
+
+    /// Save the index to the given stream.
+    void serialize(ostream& out) const;
+
+    /// Replace the contents of this index with the index in the given stream.
+    void deserialize(istream& in);
+
+protected:
+
+    /// All the groups, in file order.
+    vector<Entry> entries;
+
+    /// How many top-level chains are in the file
+    size_t num_chains = 0;
+
+    /// Magic number at the start of a serialized index
+    static const uint64_t MAGIC_NUMBER;
+
+    /// Version of the serialized format we write
+    static const uint64_t CURRENT_VERSION;
+};
+
+}
+
+#endif
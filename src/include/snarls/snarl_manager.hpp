@@ -2,6 +2,7 @@
 #define LIBSNARLS_SNARL_MANAGER_HPP_INCLUDED
 
 #include "snarls/net_graph.hpp"
+#include "snarls/snarl_file_index.hpp"
 #include "snarls/vg_types.hpp"
 
 #include <iostream>
@@ -9,12 +10,37 @@
 #include <deque>
 #include <unordered_map>
 #include <random>
+#include <memory>
+#include <mutex>
+
+namespace vg {
+namespace io {
+// We need to be able to load from MessageIterators, but we don't want to
+// expose the whole vg::io API.
+class MessageIterator;
+}
+}
 
 namespace snarls {
 
 using namespace std;
 using namespace vg;
 
+/**
+ * A lightweight, allocation-free stand-in for a Visit, used when walking
+ * around inside a snarl in tight loops. Either refers to an oriented node in
+ * the backing graph by handle, or to a managed child snarl and the
+ * orientation it is traversed in.
+ */
+struct NetVisit {
+    /// The oriented node visited, if this is a visit to a node.
+    handle_t handle;
+    /// The managed snarl visited, or nullptr if this is a visit to a node.
+    const Snarl* snarl = nullptr;
+    /// For visits to snarls, true if the snarl is traversed end to start.
+    bool backward = false;
+};
+
 /**
  * A structure to keep track of the tree relationships between Snarls and perform utility algorithms
  * on them
@@ -27,9 +53,23 @@ public:
     template <typename SnarlIterator>
     SnarlManager(SnarlIterator begin, SnarlIterator end);
         
-    /// Construct a SnarlManager for the snarls contained in an input stream
+    /// Construct a SnarlManager for the snarls contained in an input stream.
+    /// Snarls are decoded and indexed in parallel.
     SnarlManager(istream& in);
     
+    /// Construct a SnarlManager for just the snarls in the given stream that
+    /// are in top-level chains with snarl boundaries overlapping the given
+    /// inclusive node ID range, along with everything under them. The
+    /// stream must be seekable and the index must have been made when it was
+    /// serialized.
+    SnarlManager(istream& in, const SnarlFileIndex& index, nid_t min_id, nid_t max_id);
+    
+    /// Construct a SnarlManager for just the snarls in the given stream that
+    /// are in or under the top-level chains with the given sorted numbers.
+    /// The stream must be seekable and the index must have been made when it
+    /// was serialized.
+    SnarlManager(istream& in, const SnarlFileIndex& index, const vector<size_t>& chains);
+    
     /// Construct a SnarlManager from a function that calls a callback with each Snarl in turn
     SnarlManager(const function<void(const function<void(Snarl&)>&)>& for_each_snarl);
         
@@ -48,8 +88,11 @@ public:
     SnarlManager(SnarlManager&& other) = default;
     SnarlManager& operator=(SnarlManager&& other) = default;
 
-    // Can be serialized
-    void serialize(ostream& out) const;
+    /// Can be serialized. Snarls are written in parallel as block-compressed
+    /// groups, with each top-level chain and everything under it in groups
+    /// of its own. If an index is provided, the groups are recorded in it so
+    /// that the file can be read selectively.
+    void serialize(ostream& out, SnarlFileIndex* index = nullptr) const;
     
     ///////////////////////////////////////////////////////////////////////////
     // Write API
@@ -134,6 +177,22 @@ public:
     /// went through the internal graphs fo child snarls.
     NetGraph net_graph_of(const Snarl* snarl, const HandleGraph* graph, bool use_internal_connectivity = true) const;
         
+    /// Arrange for snarls to be classified on demand in the given graph, the
+    /// first time they are passed to classified(). Useful for SnarlManagers
+    /// built without snarl classification. Must be called after finish(), and
+    /// the graph must outlive the SnarlManager.
+    void enable_lazy_classification(const HandleGraph* graph);
+    
+    /// Make sure the type, connectivity, and acyclicity fields of the given
+    /// managed snarl have been computed, classifying it and any children it
+    /// depends on if lazy classification is enabled and they haven't been
+    /// yet. Returns the snarl. Safe to call from multiple threads.
+    ///
+    /// When lazy classification is enabled, don't read a snarl's type() or
+    /// connectivity fields without calling classified() on it first. Another
+    /// thread's classified() call on its parent may be writing them.
+    const Snarl* classified(const Snarl* snarl) const;
+        
     /// Returns true if snarl has no children and false otherwise
     bool is_leaf(const Snarl* snarl) const;
         
@@ -168,6 +227,25 @@ public:
     /// Look left from the given visit in the given graph and gets all the
     /// attached Visits to nodes or snarls.
     vector<Visit> visits_right(const Visit& visit, const HandleGraph& graph, const Snarl* in_snarl) const;
+    
+    /// Look left from the given visit in the given graph and call the given
+    /// function with each attached node or child snarl, without constructing
+    /// any Visit messages.
+    void for_each_visit_left(const NetVisit& visit, const HandleGraph& graph, const Snarl* in_snarl,
+                             const function<void(const NetVisit&)>& iteratee) const;
+    
+    /// Look right from the given visit in the given graph and call the given
+    /// function with each attached node or child snarl, without constructing
+    /// any Visit messages.
+    void for_each_visit_right(const NetVisit& visit, const HandleGraph& graph, const Snarl* in_snarl,
+                              const function<void(const NetVisit&)>& iteratee) const;
+    
+    /// Convert a Visit to a NetVisit in the given graph. Visits to snarls
+    /// must be to snarls managed by this SnarlManager.
+    NetVisit to_net_visit(const Visit& visit, const HandleGraph& graph) const;
+    
+    /// Convert a NetVisit back into a Visit.
+    Visit from_net_visit(const NetVisit& visit, const HandleGraph& graph) const;
         
     /// Returns a map from all Snarl boundaries to the Snarl they point into. Note that this means that
     /// end boundaries will be reversed.
@@ -302,6 +380,22 @@ private:
         
     /// Map of node traversals to the snarls they point into
     unordered_map<pair<int64_t, bool>, const Snarl*> snarl_into;
+    
+    /// Graph to classify snarls in on demand, or null if we aren't doing that
+    const HandleGraph* lazy_classification_graph = nullptr;
+    /// Flags for whether each snarl, by snarl number, has been classified on
+    /// demand
+    unique_ptr<once_flag[]> classification_flags;
+        
+    /// Construct a SnarlManager for the snarls in the index groups that the
+    /// given function calls its callback with, in file order.
+    SnarlManager(istream& in, const SnarlFileIndex& index,
+                 const function<void(const function<void(const SnarlFileIndex::Entry&)>&)>& for_each_group);
+    
+    /// Decode snarls from the given iterator into the master list, in
+    /// parallel, until the iterator runs out or reaches a group starting at
+    /// or after the given virtual offset. Pass -1 to read everything.
+    void load_snarls(vg::io::MessageIterator& iter, int64_t past_end_vo);
         
     /// Builds tree indexes after Snarls have been added to the snarls vector
     void build_indexes();
@@ -1,6 +1,7 @@
 #include "snarls/integrated_snarl_finder.hpp"
 #include "snarls/snarl_manager.hpp"
 #include "snarls/algorithms/three_edge_connected_components.hpp"
+#include "devirtualized_graph.hpp"
 
 #include <bdsg/overlays/subgraph_overlay.hpp>
 #include <bdsg/overlays/overlay_helper.hpp>
@@ -9,7 +10,10 @@
 #include <handlegraph/algorithms/weakly_connected_components.hpp>
 
 #include <array>
+#include <exception>
 #include <iostream>
+#include <limits>
+#include <memory>
 
 namespace snarls {
 
@@ -17,21 +21,334 @@ namespace snarls {
 
 using namespace std;
 
+/**
+ * A dense, 0-based ranking of the oriented handles in a HandleGraph, for
+ * indexing union-finds and other per-handle tables.
+ *
+ * When the graph's node IDs are dense, ranks are computed arithmetically from
+ * the IDs. When they are sparse but in a bounded range, we keep a table from
+ * ID to rank. Only when the IDs are spread out too far do we fall back to a
+ * ranked overlay, or to the graph's own ranks if it has them.
+ *
+ * Rank 2 * i is node i read forward, and rank 2 * i + 1 is node i read in
+ * reverse.
+ *
+ * Ranks are looked up for almost every union-find access, so we work out once
+ * both how we are ranking and what DevirtualizedGraph view we can use for the
+ * graph, and then each lookup needs only one switch.
+ */
+class DenseHandleRanking {
+public:
+    /// Rank the handles in the given graph, which must outlive us.
+    DenseHandleRanking(const HandleGraph* graph);
+    
+    /// Get the number of ranks, which is twice the node count.
+    inline size_t size() const {
+        return rank_count;
+    }
+    
+    /// Get the rank of the given handle.
+    inline size_t rank(handle_t handle) const {
+        switch (method) {
+        case ARITHMETIC_PACKED:
+            return arithmetic_rank(packed_view(), handle);
+        case ARITHMETIC_HASHED:
+            return arithmetic_rank(hashed_view(), handle);
+        case ARITHMETIC_OTHER:
+            return arithmetic_rank(other_view(), handle);
+        case TABLE_PACKED:
+            return table_rank(packed_view(), handle);
+        case TABLE_HASHED:
+            return table_rank(hashed_view(), handle);
+        case TABLE_OTHER:
+            return table_rank(other_view(), handle);
+        default:
+            // We need to 0-base the backing rank
+            return ranked_graph->handle_to_rank(handle) - 1;
+        }
+    }
+    
+    /// Get the handle with the given rank.
+    inline handle_t handle(size_t rank) const {
+        switch (method) {
+        case ARITHMETIC_PACKED:
+            return arithmetic_handle(packed_view(), rank);
+        case ARITHMETIC_HASHED:
+            return arithmetic_handle(hashed_view(), rank);
+        case ARITHMETIC_OTHER:
+            return arithmetic_handle(other_view(), rank);
+        case TABLE_PACKED:
+            return table_handle(packed_view(), rank);
+        case TABLE_HASHED:
+            return table_handle(hashed_view(), rank);
+        case TABLE_OTHER:
+            return table_handle(other_view(), rank);
+        default:
+            // We need to 1-base the rank and then get the handle.
+            return ranked_graph->rank_to_handle(rank + 1);
+        }
+    }
+    
+protected:
+    
+    /// Get the rank of the given handle when node IDs are dense.
+    template<typename View>
+    inline size_t arithmetic_rank(const View& view, handle_t handle) const {
+        return (view.get_id(handle) - min_id) * 2 + view.get_is_reverse(handle);
+    }
+    
+    /// Get the rank of the given handle when we have an ID-indexed table.
+    template<typename View>
+    inline size_t table_rank(const View& view, handle_t handle) const {
+        return id_to_node_rank[view.get_id(handle) - min_id] * 2 + view.get_is_reverse(handle);
+    }
+    
+    /// Get the handle with the given rank when node IDs are dense.
+    template<typename View>
+    inline handle_t arithmetic_handle(const View& view, size_t rank) const {
+        return view.get_handle(min_id + rank / 2, rank & 1);
+    }
+    
+    /// Get the handle with the given rank when we have an ID-indexed table.
+    template<typename View>
+    inline handle_t table_handle(const View& view, size_t rank) const {
+        return view.get_handle(node_rank_to_id[rank / 2], rank & 1);
+    }
+    
+    /// View the graph, which must be exactly a PackedGraph.
+    inline DevirtualizedGraph<bdsg::PackedGraph> packed_view() const {
+        return DevirtualizedGraph<bdsg::PackedGraph>(static_cast<const bdsg::PackedGraph&>(*graph));
+    }
+    
+    /// View the graph, which must be exactly a HashGraph.
+    inline DevirtualizedGraph<bdsg::HashGraph> hashed_view() const {
+        return DevirtualizedGraph<bdsg::HashGraph>(static_cast<const bdsg::HashGraph&>(*graph));
+    }
+    
+    /// View the graph through virtual calls.
+    inline DevirtualizedGraph<HandleGraph> other_view() const {
+        return DevirtualizedGraph<HandleGraph>(*graph);
+    }
+    
+    /// How far apart, as a multiple of the node count, node IDs can be
+    /// spread before we stop using an ID-indexed table.
+    static const size_t MAX_TABLE_SPREAD = 4;
+    
+    /// How we are computing ranks, and with what view of the graph
+    enum : uint8_t {
+        /// Node IDs are dense, so we compute ranks from them.
+        ARITHMETIC_PACKED,
+        ARITHMETIC_HASHED,
+        ARITHMETIC_OTHER,
+        /// Node IDs are in a bounded range, so we look up ranks in a table.
+        TABLE_PACKED,
+        TABLE_HASHED,
+        TABLE_OTHER,
+        /// We use the ranks from a RankedHandleGraph, and never need a view.
+        RANKED
+    } method;
+    
+    /// The graph we are ranking
+    const HandleGraph* graph;
+    
+    /// The number of ranks
+    size_t rank_count;
+    
+    /// The smallest node ID in the graph
+    nid_t min_id;
+    
+    /// In table mode, the node rank for each node ID, offset by min_id.
+    vector<size_t> id_to_node_rank;
+    
+    /// In table mode, the node ID for each node rank.
+    vector<nid_t> node_rank_to_id;
+    
+    /// In ranked mode, this owns any overlay we need.
+    bdsg::RankedOverlayHelper overlay_helper;
+    
+    /// In ranked mode, the graph we get ranks from.
+    const RankedHandleGraph* ranked_graph = nullptr;
+};
+
+DenseHandleRanking::DenseHandleRanking(const HandleGraph* graph) : graph(graph), rank_count(graph->get_node_count() * 2) {
+    size_t node_count = graph->get_node_count();
+    min_id = node_count == 0 ? 0 : graph->min_node_id();
+    // Work out how many IDs the graph spans
+    size_t id_span = node_count == 0 ? 0 : graph->max_node_id() - min_id + 1;
+    
+    // Work out what view of the graph we can use, if we compute ranks ourselves
+    DevirtualizedGraphType graph_type = devirtualized_graph_type(*graph);
+    
+    if (id_span == node_count) {
+        // No gaps, so just use arithmetic.
+        switch (graph_type) {
+        case DevirtualizedGraphType::PACKED:
+            method = ARITHMETIC_PACKED;
+            break;
+        case DevirtualizedGraphType::HASHED:
+            method = ARITHMETIC_HASHED;
+            break;
+        default:
+            method = ARITHMETIC_OTHER;
+            break;
+        }
+    } else if (id_span <= node_count * MAX_TABLE_SPREAD) {
+        // Some gaps, so find which IDs are used
+        vector<bool> used(id_span, false);
+        graph->for_each_handle([&](const handle_t& handle) {
+            used[graph->get_id(handle) - min_id] = true;
+        });
+        
+        // And rank them in ID order
+        switch (graph_type) {
+        case DevirtualizedGraphType::PACKED:
+            method = TABLE_PACKED;
+            break;
+        case DevirtualizedGraphType::HASHED:
+            method = TABLE_HASHED;
+            break;
+        default:
+            method = TABLE_OTHER;
+            break;
+        }
+        id_to_node_rank.resize(id_span, numeric_limits<size_t>::max());
+        node_rank_to_id.reserve(node_count);
+        for (size_t i = 0; i < id_span; i++) {
+            if (used[i]) {
+                id_to_node_rank[i] = node_rank_to_id.size();
+                node_rank_to_id.push_back(min_id + i);
+            }
+        }
+    } else {
+        // IDs are too spread out, so use ranks from the graph itself or an overlay.
+        method = RANKED;
+        ranked_graph = overlay_helper.apply(graph);
+    }
+}
+
+/**
+ * A map from handles to values, stored as an array indexed by dense handle
+ * rank, with a flag array saying which handles have values.
+ *
+ * Pointers to values stay valid for the life of the map. Different threads
+ * may safely write values for different handles at the same time.
+ */
+template<typename Value>
+class IntegratedSnarlFinder::DenseHandleMap {
+public:
+    /// Make an empty map over the handles with the given ranking, which must
+    /// outlive us.
+    DenseHandleMap(const DenseHandleRanking* ranking) : ranking(ranking),
+        values(ranking->size()), present(ranking->size(), 0) {
+        // Nothing to do!
+    }
+    
+    /// Return 1 if the given handle has a value, and 0 otherwise.
+    inline size_t count(handle_t key) const {
+        return present[ranking->rank(key)];
+    }
+    
+    /// Get a pointer to the value for the given handle, or null if it has
+    /// no value.
+    inline Value* find(handle_t key) {
+        size_t rank = ranking->rank(key);
+        return present[rank] ? &values[rank] : nullptr;
+    }
+    
+    /// Get a pointer to the value for the given handle, or null if it has
+    /// no value.
+    inline const Value* find(handle_t key) const {
+        size_t rank = ranking->rank(key);
+        return present[rank] ? &values[rank] : nullptr;
+    }
+    
+    /// Get the value for the given handle, which must have one.
+    inline const Value& at(handle_t key) const {
+        size_t rank = ranking->rank(key);
+        if (!present[rank]) {
+            throw out_of_range("No value for handle in DenseHandleMap");
+        }
+        return values[rank];
+    }
+    
+    /// Get the value for the given handle, giving it a default-constructed
+    /// value if it has none.
+    inline Value& operator[](handle_t key) {
+        size_t rank = ranking->rank(key);
+        if (!present[rank]) {
+            present[rank] = 1;
+            values[rank] = Value();
+        }
+        return values[rank];
+    }
+    
+    /// Remove any value for the given handle.
+    inline void erase(handle_t key) {
+        present[ranking->rank(key)] = 0;
+    }
+    
+    /// Call the given iteratee with each handle that has a value, and its
+    /// value, in rank order.
+    void for_each(const function<void(handle_t, const Value&)>& iteratee) const {
+        for (size_t rank = 0; rank < values.size(); rank++) {
+            if (present[rank]) {
+                iteratee(ranking->handle(rank), values[rank]);
+            }
+        }
+    }
+    
+protected:
+    /// The ranking we index by
+    const DenseHandleRanking* ranking;
+    /// The value for each handle rank
+    vector<Value> values;
+    /// Whether each handle rank has a value. We use bytes and not bits so
+    /// that writes for different handles don't conflict.
+    vector<uint8_t> present;
+};
+
 class IntegratedSnarlFinder::MergedAdjacencyGraph {
 protected:
-    /// Hold onto the backing RankedHandleGraph.
-    /// Union find index is handle rank - 1 (to make it 0-based).
-    const RankedHandleGraph* graph;
+    /// Hold onto the backing HandleGraph.
+    const HandleGraph* graph;
+    
+    /// Hold onto the dense handle ranking we use for indexing the union-find.
+    /// It must outlive us.
+    const DenseHandleRanking* ranking;
     
     /// Keep a union-find over the ranks of the merged oriented handles that
     /// make up each component. Runs with include_children=true so we can find
     /// all the members of each group.
     ///
     /// Needs to be mutable because union-find find operations do internal tree
-    /// massaging and aren't const.
-    /// TODO: this makes read operations not thread safe!
+    /// massaging and aren't const. So read operations are only thread safe
+    /// while we are frozen, and don't touch the union-find.
     mutable structures::UnionFind union_find;
     
+    /// A snapshot of component membership, taken from the union-find.
+    struct MembershipSnapshot {
+        /// The union-find rank of the head of the component for each
+        /// union-find rank.
+        vector<size_t> representative;
+        
+        /// The component number for each union-find rank. Components are
+        /// numbered in the order for_each_head() visits them.
+        vector<size_t> component_of;
+        
+        /// Where each component's members start in members, with a trailing
+        /// past-the-end entry.
+        vector<size_t> member_offsets;
+        
+        /// The union-find ranks of the members of each component, with the
+        /// head first.
+        vector<size_t> members;
+    };
+    
+    /// The membership snapshot, if it is up to date with the union-find, or
+    /// null otherwise. It is never modified once made, so copies of a frozen
+    /// graph share it until one of them merges something.
+    shared_ptr<const MembershipSnapshot> snapshot;
+    
     /// Get the rank corresponding to the given handle, in the union-find.
     /// Our ranks are 0-based.
     size_t uf_rank(handle_t into) const;
@@ -41,18 +358,53 @@ protected:
     handle_t uf_handle(size_t rank) const;
     
 public:
-    /// Make a MergedAdjacencyGraph representing the graph of adjacency components of the given RankedHandleGraph.
-    MergedAdjacencyGraph(const RankedHandleGraph* graph);
-    
-    /// Copy a MergedAdjacencyGraph by re-doing all the merges. Uses its own internal vectorization.
+    /// Make a MergedAdjacencyGraph representing the graph of adjacency
+    /// components of the given HandleGraph, using the given ranking of its
+    /// handles.
+    MergedAdjacencyGraph(const HandleGraph* graph, const DenseHandleRanking* ranking);
+    
+    /// Copy a MergedAdjacencyGraph by cloning its union-find directly, in
+    /// linear time and without looking at the backing graph. If the other
+    /// graph is frozen, the copy is too, and shares its membership snapshot.
     MergedAdjacencyGraph(const MergedAdjacencyGraph& other);
     
     /// Given handles reading into two components, a and b, merge them into a single component.
+    /// Invalidates any membership snapshot.
     void merge(handle_t into_a, handle_t into_b);
     
+    /// Drop any membership snapshot. Merges and reads for different
+    /// connected components may then happen in different threads at once,
+    /// since they touch disjoint parts of the union-find, and merges on a
+    /// thawed graph never write the snapshot pointer.
+    void thaw();
+    
+    /// Get the number of components. We must be frozen.
+    inline size_t component_count() const {
+        assert(snapshot);
+        return snapshot->member_offsets.size() - 1;
+    }
+    
+    /// Get the dense, 0-based number of the component with the given head,
+    /// for indexing per-component arrays. We must be frozen.
+    inline size_t component_number(handle_t head) const {
+        assert(snapshot);
+        return snapshot->component_of[uf_rank(head)];
+    }
+    
+    /// Take a snapshot of the current component membership, so that finding
+    /// heads and iterating over heads and members doesn't need to consult or
+    /// allocate from the union-find. Lasts until the next merge.
+    ///
+    /// While frozen, all the const methods are safe to call from multiple
+    /// threads at once.
+    void freeze();
+    
     /// Find the handle heading the component that the given handle is in.
     handle_t find(handle_t into) const; 
     
+    /// Get the ranking of backing graph handles that we use.
+    const DenseHandleRanking& get_ranking() const;
+    
     /// For each head, call the iteratee.
     void for_each_head(const function<void(handle_t)>& iteratee) const;
     
@@ -71,6 +423,18 @@ public:
     /// single-item components.
     void for_each_membership(const function<void(handle_t, handle_t)>& iteratee) const;
     
+    /// Find the connected components of the graph. Returns the first head,
+    /// in for_each_head() order, of each connected component, and fills in
+    /// the connected component number for each component number. We must be
+    /// frozen.
+    vector<handle_t> connected_components(vector<size_t>& connected_component_of) const;
+    
+    /// Merge together all the components that are 3-edge-connected to each
+    /// other, turning the graph into a cactus graph. Assigns the components
+    /// dense ranks straight from the union-find, so Tsin's algorithm can run
+    /// without translating components back and forth.
+    void merge_three_edge_connected_components();
+    
     /// In a graph where all 3-edge-connected components have had their nodes
     /// merged, find all the cycles. Cycles are guaranteed to overlap at at
     /// most one node, so no special handling of overlapping regions is done.
@@ -80,14 +444,15 @@ public:
     /// each edge on the cycle to the next edge, going around each cycle in one
     /// direction (for all cycles).
     ///
-    /// Ignores self loops.
-    pair<vector<pair<size_t, handle_t>>, unordered_map<handle_t, handle_t>> cycles_in_cactus() const;
+    /// Ignores self loops. We must be frozen.
+    pair<vector<pair<size_t, handle_t>>, DenseHandleMap<handle_t>> cycles_in_cactus() const;
     
     /// Find a path of cycles connecting two components in a Cactus graph.
-    /// Cycles are represented by the handle that brings that cyle into the component where it intersects the previous cycle.
+    /// Cycles are represented by the handle that brings that cyle into the component where it intersects the previous cycle,
+    /// paired with the handle that brings it into the component where it intersects the next cycle (or the end component, for the last cycle).
     /// Because the graph is a Cactus graph, cycles are a tree and intersect at at most one node.
     /// Uses the given map of cycles, stored in one orientation only, to traverse cycles.
-    vector<handle_t> find_cycle_path_in_cactus(const unordered_map<handle_t, handle_t>& next_along_cycle, handle_t start_cactus_head, handle_t end_cactus_head) const;
+    vector<pair<handle_t, handle_t>> find_cycle_path_in_cactus(const DenseHandleMap<handle_t>& next_along_cycle, handle_t start_cactus_head, handle_t end_cactus_head) const;
     
     /// Return the path length (total edge length in bp) and edges for the
     /// longest path in each tree in a forest. Ignores self loops on tree nodes.
@@ -101,7 +466,9 @@ public:
     /// Needs access to the longest simple cycles that were merged out, if any.
     /// If a path in the forest doesn't match or beat the length of the cycle
     /// that lives in its tree, it is omitted.
-    pair<vector<pair<size_t, vector<handle_t>>>, unordered_map<handle_t, handle_t>> longest_paths_in_forest(const vector<pair<size_t, handle_t>>& longest_simple_cycles) const;
+    ///
+    /// We must be frozen.
+    pair<vector<pair<size_t, vector<handle_t>>>, DenseHandleMap<handle_t>> longest_paths_in_forest(const vector<pair<size_t, handle_t>>& longest_simple_cycles) const;
     
     /// Describe the graph in dot format to the given stream;
     void to_dot(ostream& out) const;
@@ -127,18 +494,16 @@ void IntegratedSnarlFinder::MergedAdjacencyGraph::to_dot(ostream& out) const {
     out << "}" << endl;
 }
 
-size_t IntegratedSnarlFinder::MergedAdjacencyGraph::uf_rank(handle_t into) const {
-    // We need to 0-base the backing rank
-    return graph->handle_to_rank(into) - 1;
+inline size_t IntegratedSnarlFinder::MergedAdjacencyGraph::uf_rank(handle_t into) const {
+    return ranking->rank(into);
 }
 
-handle_t IntegratedSnarlFinder::MergedAdjacencyGraph::uf_handle(size_t rank) const {
-    // We need to 1-base the rank and then get the handle.
-    return graph->rank_to_handle(rank + 1);
+inline handle_t IntegratedSnarlFinder::MergedAdjacencyGraph::uf_handle(size_t rank) const {
+    return ranking->handle(rank);
 }
 
-IntegratedSnarlFinder::MergedAdjacencyGraph::MergedAdjacencyGraph(const RankedHandleGraph* graph) : graph(graph),
-    union_find(graph->get_node_count() * 2, true) {
+IntegratedSnarlFinder::MergedAdjacencyGraph::MergedAdjacencyGraph(const HandleGraph* graph, const DenseHandleRanking* ranking) :
+    graph(graph), ranking(ranking), union_find(ranking->size(), true) {
     
     // TODO: we want the adjacency components that are just single edges
     // between two handles (i.e. trivial snarls) to be implicit, so we don't
@@ -153,33 +518,114 @@ IntegratedSnarlFinder::MergedAdjacencyGraph::MergedAdjacencyGraph(const RankedHa
     // stackable, to save a copy when we want to do further merges but keep the
     // old state.
     
-    graph->for_each_edge([&](const handlegraph::edge_t& e) {
-        // Get the inward-facing version of the second handle
-        auto into_b = graph->flip(e.second);
-        
-        // Merge to create initial adjacency components
-        merge(e.first, into_b);
+    // The edges are still enumerated through the graph's std::function
+    // interface, but flipping the handles doesn't need to go through the
+    // vtable.
+    with_devirtualized_graph(*graph, [&](const auto& view) {
+        graph->for_each_edge([&](const handlegraph::edge_t& e) {
+            // Get the inward-facing version of the second handle
+            auto into_b = view.flip(e.second);
+            
+            // Merge to create initial adjacency components
+            this->merge(e.first, into_b);
+        });
     });
 }
 
-IntegratedSnarlFinder::MergedAdjacencyGraph::MergedAdjacencyGraph(const MergedAdjacencyGraph& other) : MergedAdjacencyGraph(other.graph) {
-    other.for_each_membership([&](handle_t head, handle_t member) {
-        // For anything in a component, other than its head, do the merge with the head.
-        merge(head, member);
-    });
+IntegratedSnarlFinder::MergedAdjacencyGraph::MergedAdjacencyGraph(const MergedAdjacencyGraph& other) :
+    graph(other.graph), ranking(other.ranking), union_find(other.union_find), snapshot(other.snapshot) {
+    // Nothing to do! The snapshot is immutable, so sharing it is safe.
 }
 
 void IntegratedSnarlFinder::MergedAdjacencyGraph::merge(handle_t into_a, handle_t into_b) {
+    // Throw out any snapshot, which will be out of date.
+    thaw();
+    
     // Get ranks and merge
     union_find.union_groups(uf_rank(into_a), uf_rank(into_b));
 }
 
+void IntegratedSnarlFinder::MergedAdjacencyGraph::thaw() {
+    if (snapshot) {
+        // If anyone else is sharing the snapshot, they keep it. We only write
+        // the pointer if there is something to drop, so that merges in
+        // different threads on a thawed graph don't race on it.
+        snapshot.reset();
+    }
+}
+
+void IntegratedSnarlFinder::MergedAdjacencyGraph::freeze() {
+    if (snapshot) {
+        return;
+    }
+    
+    auto fresh = make_shared<MembershipSnapshot>();
+    auto& representative = fresh->representative;
+    auto& component_of = fresh->component_of;
+    auto& member_offsets = fresh->member_offsets;
+    auto& members = fresh->members;
+    
+    // Number the components in the order we find their heads, and count
+    // their members.
+    representative.resize(union_find.size());
+    component_of.assign(union_find.size(), numeric_limits<size_t>::max());
+    member_offsets.assign(1, 0);
+    for (size_t i = 0; i < union_find.size(); i++) {
+        size_t head = union_find.find_group(i);
+        representative[i] = head;
+        if (component_of[head] == numeric_limits<size_t>::max()) {
+            // This is a new component
+            component_of[head] = member_offsets.size() - 1;
+            member_offsets.push_back(0);
+        }
+        component_of[i] = component_of[head];
+        member_offsets[component_of[i] + 1]++;
+    }
+    for (size_t i = 1; i < member_offsets.size(); i++) {
+        member_offsets[i] += member_offsets[i - 1];
+    }
+    
+    // Lay out the members, heads first.
+    members.resize(union_find.size());
+    vector<size_t> cursors(member_offsets.begin(), member_offsets.end() - 1);
+    for (size_t i = 0; i < union_find.size(); i++) {
+        if (representative[i] == i) {
+            members[cursors[component_of[i]]++] = i;
+        }
+    }
+    for (size_t i = 0; i < union_find.size(); i++) {
+        if (representative[i] != i) {
+            members[cursors[component_of[i]]++] = i;
+        }
+    }
+    
+    snapshot = move(fresh);
+}
+
+const DenseHandleRanking& IntegratedSnarlFinder::MergedAdjacencyGraph::get_ranking() const {
+    return *ranking;
+}
+
 handle_t IntegratedSnarlFinder::MergedAdjacencyGraph::find(handle_t into) const {
+    if (snapshot) {
+        // The head is already worked out, and we don't touch the union-find.
+        return uf_handle(snapshot->representative[uf_rank(into)]);
+    }
     // Get rank, find head, and get handle
     return uf_handle(union_find.find_group(uf_rank(into)));
 }
 
 void IntegratedSnarlFinder::MergedAdjacencyGraph::for_each_head(const function<void(handle_t)>& iteratee) const {
+    if (snapshot) {
+        // Heads are first in each component in the snapshot.
+        auto& member_offsets = snapshot->member_offsets;
+        auto& members = snapshot->members;
+        for (size_t i = 0; i + 1 < member_offsets.size(); i++) {
+            iteratee(uf_handle(members[member_offsets[i]]));
+        }
+        return;
+    }
+    
     // TODO: is this better or worse than getting the vector of vectors of the whole union-find?
     // TODO: make iterating groups an actual capability that the union-find has, in O(groups).
     // This lets us do it in O(total items).
@@ -204,6 +650,17 @@ void IntegratedSnarlFinder::MergedAdjacencyGraph::for_each_head(const function<v
 
 void IntegratedSnarlFinder::MergedAdjacencyGraph::for_each_other_member(handle_t head, const function<void(handle_t)>& iteratee) const {
     size_t head_rank = uf_rank(head);
+    if (snapshot) {
+        auto& member_offsets = snapshot->member_offsets;
+        auto& members = snapshot->members;
+        size_t component = snapshot->component_of[head_rank];
+        for (size_t i = member_offsets[component]; i < member_offsets[component + 1]; i++) {
+            if (members[i] != head_rank) {
+                iteratee(uf_handle(members[i]));
+            }
+        }
+        return;
+    }
     // Find the group the head is in
     vector<size_t> group = union_find.group(head_rank);
     for (auto& member_rank : group) {
@@ -218,6 +675,15 @@ void IntegratedSnarlFinder::MergedAdjacencyGraph::for_each_other_member(handle_t
 
 void IntegratedSnarlFinder::MergedAdjacencyGraph::for_each_member(handle_t head, const function<void(handle_t)>& iteratee) const {
     size_t head_rank = uf_rank(head);
+    if (snapshot) {
+        auto& member_offsets = snapshot->member_offsets;
+        auto& members = snapshot->members;
+        size_t component = snapshot->component_of[head_rank];
+        for (size_t i = member_offsets[component]; i < member_offsets[component + 1]; i++) {
+            iteratee(uf_handle(members[i]));
+        }
+        return;
+    }
     // Find the group the head is in
     vector<size_t> group = union_find.group(head_rank);
     for (auto& member_rank : group) {
@@ -228,6 +694,19 @@ void IntegratedSnarlFinder::MergedAdjacencyGraph::for_each_member(handle_t head,
 }
 
 void IntegratedSnarlFinder::MergedAdjacencyGraph::for_each_membership(const function<void(handle_t, handle_t)>& iteratee) const {
+    if (snapshot) {
+        auto& member_offsets = snapshot->member_offsets;
+        auto& members = snapshot->members;
+        for (size_t i = 0; i + 1 < member_offsets.size(); i++) {
+            handle_t head = uf_handle(members[member_offsets[i]]);
+            for (size_t j = member_offsets[i] + 1; j < member_offsets[i + 1]; j++) {
+                // For everything other than the head, announce with the head.
+                iteratee(head, uf_handle(members[j]));
+            }
+        }
+        return;
+    }
+    
     // We do this weird iteration because it's vaguely efficient in the union-find we use.
     vector<vector<size_t>> uf_components = union_find.all_groups();
     
@@ -240,11 +719,115 @@ void IntegratedSnarlFinder::MergedAdjacencyGraph::for_each_membership(const func
     }
 }
 
-pair<vector<pair<size_t, handle_t>>, unordered_map<handle_t, handle_t>> IntegratedSnarlFinder::MergedAdjacencyGraph::cycles_in_cactus() const {
+vector<handle_t> IntegratedSnarlFinder::MergedAdjacencyGraph::connected_components(vector<size_t>& connected_component_of) const {
+    vector<handle_t> roots;
+    
+    auto& component_of = snapshot->component_of;
+    auto& member_offsets = snapshot->member_offsets;
+    auto& members = snapshot->members;
+    
+    connected_component_of.assign(component_count(), numeric_limits<size_t>::max());
+    vector<size_t> queue;
+    for (size_t root = 0; root < component_count(); root++) {
+        // Components are numbered in head order
+        if (connected_component_of[root] != numeric_limits<size_t>::max()) {
+            continue;
+        }
+        
+        // This is the first head in a new connected component. Flood it.
+        connected_component_of[root] = roots.size();
+        roots.push_back(uf_handle(members[member_offsets[root]]));
+        queue.push_back(root);
+        while (!queue.empty()) {
+            size_t here = queue.back();
+            queue.pop_back();
+            for (size_t i = member_offsets[here]; i < member_offsets[here + 1]; i++) {
+                // Follow each member edge by flipping it
+                size_t next = component_of[uf_rank(graph->flip(uf_handle(members[i])))];
+                if (connected_component_of[next] == numeric_limits<size_t>::max()) {
+                    connected_component_of[next] = connected_component_of[root];
+                    queue.push_back(next);
+                }
+            }
+        }
+    }
+    
+    return roots;
+}
+
+void IntegratedSnarlFinder::MergedAdjacencyGraph::merge_three_edge_connected_components() {
+    // Use the membership snapshot to give each component a dense rank, and
+    // to find the union-find rank of its head.
+    freeze();
+    // Hold our own reference, since our merges will drop the snapshot.
+    shared_ptr<const MembershipSnapshot> frozen_snapshot = snapshot;
+    auto& component_of = frozen_snapshot->component_of;
+    auto& member_offsets = frozen_snapshot->member_offsets;
+    auto& members = frozen_snapshot->members;
+    vector<size_t> head_of_component(member_offsets.size() - 1);
+    for (size_t i = 0; i < head_of_component.size(); i++) {
+        head_of_component[i] = members[member_offsets[i]];
+    }
+    
+#ifdef debug
+    cerr << "Ranked " << head_of_component.size() << " components for 3ecc merging" << endl;
+#endif
+    
+    // Find the component each member handle connects to, by flipping it, and
+    // lay the connections out by component. We don't deduplicate or filter,
+    // because we want all multi-edges.
+    vector<size_t> edge_offsets(head_of_component.size() + 1, 0);
+    vector<size_t> edge_targets(union_find.size());
+    with_devirtualized_graph(*graph, [&](const auto& view) {
+        for (size_t i = 0; i < union_find.size(); i++) {
+            handle_t member = this->uf_handle(i);
+            edge_targets[i] = component_of[this->uf_rank(view.flip(member))];
+            if (edge_targets[i] == component_of[i] && view.get_is_reverse(member)) {
+                // For self loops, only follow them in one direction. Skip in the other.
+                edge_targets[i] = numeric_limits<size_t>::max();
+            } else {
+                edge_offsets[component_of[i] + 1]++;
+            }
+        }
+    });
+    for (size_t i = 1; i < edge_offsets.size(); i++) {
+        edge_offsets[i] += edge_offsets[i - 1];
+    }
+    vector<size_t> component_edges(edge_offsets.back());
+    vector<size_t> cursors(edge_offsets.begin(), edge_offsets.end() - 1);
+    for (size_t i = 0; i < union_find.size(); i++) {
+        if (edge_targets[i] != numeric_limits<size_t>::max()) {
+            component_edges[cursors[component_of[i]]++] = edge_targets[i];
+        }
+    }
+    edge_targets.clear();
+    edge_targets.shrink_to_fit();
+    cursors.clear();
+    cursors.shrink_to_fit();
+    
+    // Buffer merges until the algorithm is done, since we can't let the
+    // merges be visible to the algorithm while it is working.
+    vector<pair<size_t, size_t>> merge_list;
+    // Multi-edges are OK.
+    // TODO: three_edge_connected_component_merges_dense_parallel() can do
+    // each 2-edge-connected piece of the graph in parallel, but we haven't
+    // timed it here yet, so we stick with the serial version.
+    algorithms::three_edge_connected_component_merges_dense(edge_offsets, component_edges, 0, [&](size_t a, size_t b) {
+        merge_list.emplace_back(a, b);
+    });
+    
+    // Now execute the merges, since the algorithm is done looking at the graph.
+    for (auto& ab : merge_list) {
+        merge(uf_handle(head_of_component[ab.first]), uf_handle(head_of_component[ab.second]));
+    }
+}
+
+pair<vector<pair<size_t, handle_t>>, IntegratedSnarlFinder::DenseHandleMap<handle_t>> IntegratedSnarlFinder::MergedAdjacencyGraph::cycles_in_cactus() const {
     // Do a DFS over all connected components of the graph
     
     // We will fill this in
-    pair<vector<pair<size_t, handle_t>>, unordered_map<handle_t, handle_t>> to_return;
+    pair<vector<pair<size_t, handle_t>>, DenseHandleMap<handle_t>> to_return(piecewise_construct, forward_as_tuple(),
+                                                                            forward_as_tuple(ranking));
     auto& longest_cycles = to_return.first;
     auto& next_edge = to_return.second;
     
@@ -260,8 +843,9 @@ pair<vector<pair<size_t, handle_t>>, unordered_map<handle_t, handle_t>> Integrat
     // If you see something visited already, it must still be on the stack.
     // Otherwise it would have already visited you when it was on the stack.
     //
-    // This is on heads, representing nodes.
-    unordered_map<handle_t, size_t> visited_frame;
+    // This is on components, representing nodes.
+    const size_t UNVISITED = numeric_limits<size_t>::max();
+    vector<size_t> visited_frame(component_count(), UNVISITED);
     
     // We need a stack.
     // Stack is actually in terms of inward edges followed.
@@ -270,185 +854,210 @@ pair<vector<pair<size_t, handle_t>>, unordered_map<handle_t, handle_t>> Integrat
         vector<handle_t> todo;
     };
     
-    vector<DFSFrame> stack;
+    // Connected components don't interact, so we can search them all in
+    // parallel, starting from the same roots a serial search would use.
+    vector<size_t> connected_component_of;
+    vector<handle_t> roots = connected_components(connected_component_of);
+    vector<pair<size_t, handle_t>> root_longest_cycles(roots.size());
     
-    for_each_head([&](handle_t component_root) {
-        // For every node in the graph
-        
-        if (!visited_frame.count(component_root)) {
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t root_number = 0; root_number < roots.size(); root_number++) {
+        // For every connected component in the graph
+        handle_t component_root = roots[root_number];
         
 #ifdef debug
-            cerr << "Root simple cycle search at " << graph->get_id(component_root) << (graph->get_is_reverse(component_root) ? "-" : "+") << endl; 
+        cerr << "Root simple cycle search at " << graph->get_id(component_root) << (graph->get_is_reverse(component_root) ? "-" : "+") << endl; 
 #endif
         
-            // If it hasn't been searched yet, start a search of its connected component.
-            stack.emplace_back();
-            stack.back().here = component_root;
+        // Start a search of its connected component.
+        vector<DFSFrame> stack;
+        stack.emplace_back();
+        stack.back().here = component_root;
+        
+        // We'll put the longest cycle start edge result here, or leave it empty if we find no cycle.
+        auto& longest_cycle = root_longest_cycles[root_number];
+        
+        while (!stack.empty()) {
+            // Until the DFS is done
+            auto& frame = stack.back();
+            // Find the node that following this edge got us to.
+            auto frame_head = find(frame.here);
             
-            // We'll put the longest cycle start edge result here, or get rid of it if we find no cycle.
-            longest_cycles.emplace_back();
-            auto& longest_cycle = longest_cycles.back();
+#ifdef debug
+            cerr << "At stack frame " << stack.size() - 1 << " for edge " << graph->get_id(frame.here) << (graph->get_is_reverse(frame.here) ? "-" : "+") 
+                << " on component " << graph->get_id(frame_head) << (graph->get_is_reverse(frame_head) ? "-" : "+") << endl; 
+#endif
             
-            while (!stack.empty()) {
-                // Until the DFS is done
-                auto& frame = stack.back();
-                // Find the node that following this edge got us to.
-                auto frame_head = find(frame.here);
+            size_t& frame_visited = visited_frame[component_number(frame_head)];
+            if (frame_visited == UNVISITED) {
+                // First visit to here.
                 
 #ifdef debug
-                cerr << "At stack frame " << stack.size() - 1 << " for edge " << graph->get_id(frame.here) << (graph->get_is_reverse(frame.here) ? "-" : "+") 
-                    << " on component " << graph->get_id(frame_head) << (graph->get_is_reverse(frame_head) ? "-" : "+") << endl; 
+                cerr << "\tFirst visit" << endl; 
 #endif
                 
-                auto frame_it = visited_frame.find(frame_head);
-                if (frame_it == visited_frame.end()) {
-                    // First visit to here.
+                // Mark visited at this stack level
+                frame_visited = stack.size() - 1;
+                
+                // Queue up edges
+                for_each_member(frame_head, [&](handle_t member) {
+                    if (member != frame.here || stack.size() == 1) {
+                        // If it's not just turning around and looking up
+                        // the edge we took to get here, or if we're the
+                        // top stack frame and we didn't come from anywhere
+                        // anyway
+                    
+                        // Follow edge by flipping. But queue up the edge
+                        // followed instead of the node reached (head), so we
+                        // can emit the cycle later in terms of edges.
+                        frame.todo.push_back(graph->flip(member));
                     
 #ifdef debug
-                    cerr << "\tFirst visit" << endl; 
+                        cerr << "\t\tNeed to follow " << graph->get_id(frame.todo.back()) << (graph->get_is_reverse(frame.todo.back()) ? "-" : "+") << endl; 
 #endif
-                    
-                    // Mark visited at this stack level
-                    frame_it = visited_frame.emplace_hint(frame_it, frame_head, stack.size() - 1);
-                    
-                    // Queue up edges
-                    for_each_member(frame_head, [&](handle_t member) {
-                        if (member != frame.here || stack.size() == 1) {
-                            // If it's not just turning around and looking up
-                            // the edge we took to get here, or if we're the
-                            // top stack frame and we didn't come from anywhere
-                            // anyway
-                        
-                            // Follow edge by flipping. But queue up the edge
-                            // followed instead of the node reached (head), so we
-                            // can emit the cycle later in terms of edges.
-                            frame.todo.push_back(graph->flip(member));
-                        
+                    }
+                });
+            }
+            
+            if (!frame.todo.empty()) {
+                // Now do an edge
+                handle_t edge_into = frame.todo.back();
+                handle_t connected_head = find(edge_into);
+                frame.todo.pop_back();
+                
 #ifdef debug
-                            cerr << "\t\tNeed to follow " << graph->get_id(frame.todo.back()) << (graph->get_is_reverse(frame.todo.back()) ? "-" : "+") << endl; 
+                cerr << "\tFollow " << graph->get_id(edge_into) << (graph->get_is_reverse(edge_into) ? "-" : "+")
+                    << " to component " << graph->get_id(connected_head) << (graph->get_is_reverse(connected_head) ? "-" : "+") << endl; 
 #endif
-                        }
-                    });
-                }
                 
-                if (!frame.todo.empty()) {
-                    // Now do an edge
-                    handle_t edge_into = frame.todo.back();
-                    handle_t connected_head = find(edge_into);
-                    frame.todo.pop_back();
-                    
+                size_t connected_visited = visited_frame[component_number(connected_head)];
+                
+                if (connected_visited == UNVISITED) {
+                
 #ifdef debug
-                    cerr << "\tFollow " << graph->get_id(edge_into) << (graph->get_is_reverse(edge_into) ? "-" : "+")
-                        << " to component " << graph->get_id(connected_head) << (graph->get_is_reverse(connected_head) ? "-" : "+") << endl; 
+                    cerr << "\t\tNot yet visited. Recurse!" << endl; 
 #endif
-                    
-                    auto connected_it = visited_frame.find(connected_head);
-                    
-                    if (connected_it == visited_frame.end()) {
-                    
+                
+                    // Forward edge. Recurse.
+                    stack.emplace_back();
+                    stack.back().here = edge_into;
+                } else {
+                    // Back edge
+                    if (frame_visited > connected_visited) {
+                        // We have an edge to something that was visited above
+                        // our stack level. It can't be a self loop, and it
+                        // must close a unique cycle.
+                        
 #ifdef debug
-                        cerr << "\t\tNot yet visited. Recurse!" << endl; 
+                        cerr << "\tBack edge up stack to frame " << connected_visited << endl; 
 #endif
                     
-                        // Forward edge. Recurse.
-                        // TODO: this immediately does a lookup in the hash table again.
-                        stack.emplace_back();
-                        stack.back().here = edge_into;
-                    } else {
-                        // Back edge
-                        if (frame_it->second > connected_it->second) {
-                            // We have an edge to something that was visited above
-                            // our stack level. It can't be a self loop, and it
-                            // must close a unique cycle.
-                            
 #ifdef debug
-                            cerr << "\tBack edge up stack to frame " << connected_it->second << endl; 
+                        cerr << "\t\tFound cycle:" << endl; 
 #endif
                         
-#ifdef debug
-                            cerr << "\t\tFound cycle:" << endl; 
-#endif
+                        // Walk and measure the cycle. But don't count the
+                        // frame we arrived at because its incoming edge
+                        // isn't actually on the cycle.
+                        size_t cycle_length_bp = graph->get_length(edge_into);
+                        handle_t prev_edge = edge_into;
+                        for (size_t i = connected_visited + 1; i < stack.size(); i++) {
+                            // For each edge along the cycle...
                             
-                            // Walk and measure the cycle. But don't count the
-                            // frame we arrived at because its incoming edge
-                            // isn't actually on the cycle.
-                            size_t cycle_length_bp = graph->get_length(edge_into);
-                            handle_t prev_edge = edge_into;
-                            for (size_t i = connected_it->second + 1; i < stack.size(); i++) {
-                                // For each edge along the cycle...
-                                
 #ifdef debug
-                                cerr << "\t\t\t" << graph->get_id(stack[i].here) << (graph->get_is_reverse(stack[i].here) ? "-" : "+") << endl; 
+                            cerr << "\t\t\t" << graph->get_id(stack[i].here) << (graph->get_is_reverse(stack[i].here) ? "-" : "+") << endl; 
 #endif
-                                
-                                // Measure it
-                                cycle_length_bp += graph->get_length(stack[i].here);
-                                // Record the cycle membership
-                                next_edge[prev_edge] = stack[i].here;
-                                // Advance
-                                prev_edge = stack[i].here;
-                            }
-                            // Close the cycle
-                            next_edge[prev_edge] = edge_into;
                             
+                            // Measure it
+                            cycle_length_bp += graph->get_length(stack[i].here);
+                            // Record the cycle membership
+                            next_edge[prev_edge] = stack[i].here;
+                            // Advance
+                            prev_edge = stack[i].here;
+                        }
+                        // Close the cycle
+                        next_edge[prev_edge] = edge_into;
+                        
 #ifdef debug
-                            cerr << "\t\t\t" << graph->get_id(edge_into) << (graph->get_is_reverse(edge_into) ? "-" : "+") << endl; 
+                        cerr << "\t\t\t" << graph->get_id(edge_into) << (graph->get_is_reverse(edge_into) ? "-" : "+") << endl; 
 #endif
-                            
+                        
 #ifdef debug
-                            cerr << "\t\tCycle length: " << cycle_length_bp << " bp" << endl; 
+                        cerr << "\t\tCycle length: " << cycle_length_bp << " bp" << endl; 
 #endif
+                        
+                        if (cycle_length_bp > longest_cycle.first) {
+                            // New longest cycle (or maybe only longest cycle).
                             
-                            if (cycle_length_bp > longest_cycle.first) {
-                                // New longest cycle (or maybe only longest cycle).
-                                
 #ifdef debug
-                                cerr << "\t\t\tNew longest cycle!" << endl; 
+                            cerr << "\t\t\tNew longest cycle!" << endl; 
 #endif
-                                
-                                // TODO: Assumes no cycles are 0-length
-                                longest_cycle.first = cycle_length_bp;
-                                longest_cycle.second = edge_into;
-                            }
+                            
+                            // TODO: Assumes no cycles are 0-length
+                            longest_cycle.first = cycle_length_bp;
+                            longest_cycle.second = edge_into;
                         }
                     }
-                } else {
-                    // Now we're done with this stack frame.
-                    
-                    // Clean up
-                    stack.pop_back();
                 }
-            }
-            
-            if (longest_cycle.first == 0) {
-                // No (non-empty) nontrivial cycle found in this connected component.
-                // Remove its spot.
-                longest_cycles.pop_back();
+            } else {
+                // Now we're done with this stack frame.
+                
+                // Clean up
+                stack.pop_back();
             }
         }
-    });
+        
+    }
+    
+    for (auto& longest_cycle : root_longest_cycles) {
+        if (longest_cycle.first != 0) {
+            // A (non-empty) nontrivial cycle was found in this connected
+            // component. Keep them in root order.
+            longest_cycles.push_back(longest_cycle);
+        }
+    }
    
 #ifdef debug
     cerr << "Cycle links:" << endl;
-    for (auto& kv : next_edge) {
-        cerr << "\t" << graph->get_id(kv.first) << (graph->get_is_reverse(kv.first) ? "-" : "+")
-            << " -> " << graph->get_id(kv.second) << (graph->get_is_reverse(kv.second) ? "-" : "+") << endl;
-    }
+    next_edge.for_each([&](handle_t from, handle_t to) {
+        cerr << "\t" << graph->get_id(from) << (graph->get_is_reverse(from) ? "-" : "+")
+            << " -> " << graph->get_id(to) << (graph->get_is_reverse(to) ? "-" : "+") << endl;
+    });
 #endif
    
     return to_return;
 }
 
-vector<handle_t> IntegratedSnarlFinder::MergedAdjacencyGraph::find_cycle_path_in_cactus(const unordered_map<handle_t, handle_t>& next_along_cycle, handle_t start_head, handle_t end_head) const {
+vector<pair<handle_t, handle_t>> IntegratedSnarlFinder::MergedAdjacencyGraph::find_cycle_path_in_cactus(const DenseHandleMap<handle_t>& next_along_cycle, handle_t start_head, handle_t end_head) const {
     // We fill this in with a path of cycles.
-    // Each cycle is the edge on that cycle leading into the node that it shares with the previous cycle.
-    vector<handle_t> cycle_path;
+    // Each cycle is the edge on that cycle leading into the node that it
+    // shares with the previous cycle, and the edge on that cycle leading into
+    // the node it shares with the next cycle.
+    vector<pair<handle_t, handle_t>> cycle_path;
+    
+    // TODO: Each call is a fresh DFS over the cycle tree from the start
+    // component, walking around every cycle it reaches and scanning the
+    // members of every node on those cycles. That can be most of the cactus
+    // component, so a decomposition with many bridge paths that skip cycles
+    // is quadratic here. Returning exit edges only saved walking the found
+    // cycles a second time. An ancestry index over the cycle tree would bound
+    // the search to the path, but every pinch rewrites next_along_cycle and
+    // merges components, so it would need to be kept up to date as we go.
     
     // We just DFS through the cycle tree until we find one that touches the
     // other node. We represent each cycle by an edge on it into the node where
     // it overlaps the parent cycle, and store the current cycle and the other
-    // cycles to do that share nodes.
-    vector<tuple<handle_t, vector<handle_t>, bool>> cycle_stack;
+    // cycles to do that share nodes, each with the edge on the current cycle
+    // into the node they share. We also remember the edge into the node
+    // shared with the child cycle we are currently looking at, so the caller
+    // doesn't need to walk the cycles again to find it.
+    struct CycleFrame {
+        handle_t entry;
+        handle_t exit;
+        vector<pair<handle_t, handle_t>> children;
+        bool visited;
+    };
+    vector<CycleFrame> cycle_stack;
     
     // We have a list of DFS roots we can stop early on.
     vector<handle_t> roots;
@@ -461,20 +1070,21 @@ vector<handle_t> IntegratedSnarlFinder::MergedAdjacencyGraph::find_cycle_path_in
     
     for (auto& root : roots) {
         // Root at each root
-        cycle_stack.emplace_back(root, vector<handle_t>(), false);
+        cycle_stack.push_back({root, root, {}, false});
         while (!cycle_stack.empty()) {
             auto& cycle_frame = cycle_stack.back();
-            if (!get<2>(cycle_frame)) {
+            if (!cycle_frame.visited) {
                 // First visit
-                get<2>(cycle_frame) = true;
+                cycle_frame.visited = true;
                 
                 // Need to fill in child cycles.
-                for (auto it = next_along_cycle.find(get<0>(cycle_frame)); it->second != get<0>(cycle_frame); it = next_along_cycle.find(it->second)) {
-                    // For each other edge around the cycle (in it->second) other than the one we started at
+                for (handle_t it = next_along_cycle.at(cycle_frame.entry); it != cycle_frame.entry; it = next_along_cycle.at(it)) {
+                    // For each other edge around the cycle (in it) other than the one we started at
                     
-                    handle_t node = find(it->second);
+                    handle_t node = find(it);
                     if (node == end_head) {
                         // This cycle intersects the destination. It is the last on the cycle path.
+                        cycle_frame.exit = it;
                         
                         // Copy the path on the stack over.
                         // Note that the first think on the path is in the
@@ -482,7 +1092,7 @@ vector<handle_t> IntegratedSnarlFinder::MergedAdjacencyGraph::find_cycle_path_in
                         // isn't in the end's component.
                         cycle_path.reserve(cycle_stack.size());
                         for (auto& f : cycle_stack) {
-                            cycle_path.push_back(get<0>(f));
+                            cycle_path.emplace_back(f.entry, f.exit);
                         }
                         
                         // Now the cycle path is done
@@ -491,18 +1101,20 @@ vector<handle_t> IntegratedSnarlFinder::MergedAdjacencyGraph::find_cycle_path_in
                     
                     for_each_member(node, [&](handle_t inbound) {
                         // For each edge in the component it enters
-                        if (inbound != it->second && next_along_cycle.count(inbound)) {
+                        if (inbound != it && next_along_cycle.count(inbound)) {
                             // This edge is a cycle coming into a node our current cycle touches.
-                            get<1>(cycle_frame).push_back(inbound);
+                            cycle_frame.children.emplace_back(inbound, it);
                         }
                     });
                 }
             }
-            if (!get<1>(cycle_frame).empty()) {
-                // Need to recurse on a connected cycle.
-                handle_t child = get<1>(cycle_frame).back();
-                get<1>(cycle_frame).pop_back();
-                cycle_stack.emplace_back(child, vector<handle_t>(), false);
+            if (!cycle_frame.children.empty()) {
+                // Need to recurse on a connected cycle, through the node we
+                // share with it.
+                handle_t child = cycle_frame.children.back().first;
+                cycle_frame.exit = cycle_frame.children.back().second;
+                cycle_frame.children.pop_back();
+                cycle_stack.push_back({child, child, {}, false});
             } else {
                 // Need to clean up and return
                 cycle_stack.pop_back();
@@ -515,7 +1127,7 @@ vector<handle_t> IntegratedSnarlFinder::MergedAdjacencyGraph::find_cycle_path_in
     throw runtime_error("Cound not find cycle path!");
 }
 
-pair<vector<pair<size_t, vector<handle_t>>>, unordered_map<handle_t, handle_t>> IntegratedSnarlFinder::MergedAdjacencyGraph::longest_paths_in_forest(
+pair<vector<pair<size_t, vector<handle_t>>>, IntegratedSnarlFinder::DenseHandleMap<handle_t>> IntegratedSnarlFinder::MergedAdjacencyGraph::longest_paths_in_forest(
     const vector<pair<size_t, handle_t>>& longest_simple_cycles) const {
     
     // TODO: somehow unify DFS logic with cycle-finding DFS in a way that still
@@ -527,7 +1139,8 @@ pair<vector<pair<size_t, vector<handle_t>>>, unordered_map<handle_t, handle_t>>
     // we get to where we rooted the DFS.
     
     // Set up the return value
-    pair<vector<pair<size_t, vector<handle_t>>>, unordered_map<handle_t, handle_t>> to_return;
+    pair<vector<pair<size_t, vector<handle_t>>>, DenseHandleMap<handle_t>> to_return(piecewise_construct, forward_as_tuple(),
+                                                                                    forward_as_tuple(ranking));
     
     // When we find a longest path in a connected component (tree), we put its
     // length and value in here. We describe it as edges followed.
@@ -541,8 +1154,8 @@ pair<vector<pair<size_t, vector<handle_t>>>, unordered_map<handle_t, handle_t>>
     // leaf-leaf path. Indexed by head.
     auto& deepest_child_edge = to_return.second;
     
-    // The DFS also needs records, one per component, indexed by head.
-    // Absence of a record = unvisited.
+    // The DFS also needs records, one per component, indexed by component
+    // number. Absence of a record = unvisited.
     struct DFSRecord {
         // Remember the edge to traverse to get back to the parent, so we can
         // find the path from the longest leaf-leaf path's converging node to
@@ -550,11 +1163,17 @@ pair<vector<pair<size_t, vector<handle_t>>>, unordered_map<handle_t, handle_t>>
         handle_t parent_edge;
         // How long is the deepest path to a leaf from here, plus the length of
         // the edge followed to here from the parent?
-        // Filled in when we leave the stack, by looking at deepest_child_edge.
+        // Filled in when we leave the stack, from deepest_child_length.
         size_t leaf_path_length = 0;
+        // How long is the path to a leaf through the child that
+        // deepest_child_edge points to, if any? We keep it here so we don't
+        // need to find the child's record again.
+        size_t deepest_child_length = 0;
         // What edge goes to the second-deepest child, if we have one, to form
         // the longest leaf-leaf path converging here?
         handle_t second_deepest_child_edge;
+        // And how long is the path to a leaf through it?
+        size_t second_deepest_child_length = 0;
         // And do we have such a second-deepest child?
         bool has_second_deepest_child = false;
         // And what head in the graph is the convergance point of the longest
@@ -570,29 +1189,94 @@ pair<vector<pair<size_t, vector<handle_t>>>, unordered_map<handle_t, handle_t>>
         // we track the longest subtree paht length here as well. Will be 0
         // when there is no subtree leaf-leaf path.
         size_t longest_subtree_path_length;
+        // Set when the DFS first reaches this component. We keep this here
+        // and not in a bitvector so threads working on different trees don't
+        // conflict.
+        bool visited = false;
     };
-    unordered_map<handle_t, DFSRecord> records;
+    vector<DFSRecord> records(component_count());
     
     
     // We need a stack.
     // Stack is actually in terms of inward edges followed.
     struct DFSFrame {
         handle_t here;
+        // What component number following here got us to
+        size_t component;
         // What edges still need to be followed
         vector<handle_t> todo;
     };
     
-    vector<DFSFrame> stack;
+    // When a child is finished, or when rerooting makes a former parent into
+    // a child, we mix it in to its parent's deepest and second-deepest
+    // children, using the child's leaf path length.
+    auto mix_child = [&](handle_t parent_head, DFSRecord& parent_record, handle_t child_edge, size_t child_leaf_path_length) {
+        // Fill in deepest_child_edge for the parent if not filled in already, or if we beat what's there.
+        // Also maintain parent's second_deepest_child_edge.
+        auto parent_deepest_child_it = deepest_child_edge.find(parent_head);
+        if (parent_deepest_child_it == nullptr) {
+        
+#ifdef debug
+            cerr << "\t\tWe are our parent's deepest child by default!" << endl;
+#endif
+        
+            // Fill in the map where we didn't find anything.
+            deepest_child_edge[parent_head] = child_edge;
+            parent_record.deepest_child_length = child_leaf_path_length;
+        } else if (parent_record.deepest_child_length < child_leaf_path_length) {
+            // We are longer than what's there now
+            
+#ifdef debug
+            cerr << "\t\tWe are our parent's new deepest child!" << endl;
+#endif
+            
+            // Demote what's there to second-best
+            parent_record.second_deepest_child_edge = *parent_deepest_child_it;
+            parent_record.second_deepest_child_length = parent_record.deepest_child_length;
+            parent_record.has_second_deepest_child = true;
+            
+#ifdef debug
+            cerr << "\t\t\tWe demote "
+                << graph->get_id(parent_record.second_deepest_child_edge) << (graph->get_is_reverse(parent_record.second_deepest_child_edge) ? "-" : "+")
+                << " to second-deepest child" << endl;
+#endif
+            
+            // Replace the value we found
+            *parent_deepest_child_it = child_edge;
+            parent_record.deepest_child_length = child_leaf_path_length;
+        } else if (!parent_record.has_second_deepest_child) {
+            
+#ifdef debug
+            cerr << "\t\tWe are our parent's second deepest child by default!" << endl;
+#endif
+            
+            // There's no second-deepest recorded so we must be it.
+            parent_record.second_deepest_child_edge = child_edge;
+            parent_record.second_deepest_child_length = child_leaf_path_length;
+            parent_record.has_second_deepest_child = true;
+        } else if (parent_record.second_deepest_child_length < child_leaf_path_length) {
+            
+#ifdef debug
+            cerr << "\t\tWe are our parent's new second deepest child!" << endl;
+#endif
+            
+            // We are a new second deepest child.
+            parent_record.second_deepest_child_edge = child_edge;
+            parent_record.second_deepest_child_length = child_leaf_path_length;
+        }
+    };
     
     // We have a function to try DFS from a root, if the root is unvisited.
     // If root_cycle_length is nonzero, we will not rewrite deepest_child_edge
     // to point towards the longest leaf-leaf path, if it isn't as long as the
-    // cycle or longer.
-    auto try_root = [&](handle_t traversal_root, size_t root_cycle_length) {
-        if (!records.count(traversal_root)) {
+    // cycle or longer. Any longest tree path found goes in found_paths.
+    auto try_root = [&](handle_t traversal_root, size_t root_cycle_length, vector<pair<size_t, vector<handle_t>>>& found_paths) {
+        if (!records[component_number(traversal_root)].visited) {
             // If it hasn't been searched yet, start a search
+            vector<DFSFrame> stack;
             stack.emplace_back();
             stack.back().here = traversal_root;
+            stack.back().component = component_number(traversal_root);
             
 #ifdef debug
             cerr << "Root bridge tree traversal at " << graph->get_id(traversal_root) << (graph->get_is_reverse(traversal_root) ? "-" : "+") << endl;
@@ -603,14 +1287,14 @@ pair<vector<pair<size_t, vector<handle_t>>>, unordered_map<handle_t, handle_t>>
                 auto& frame = stack.back();
                 // Find the node that following this edge got us to.
                 auto frame_head = find(frame.here);
+                size_t frame_component = frame.component;
                 
 #ifdef debug
                 cerr << "At stack frame " << stack.size() - 1 << " for edge " << graph->get_id(frame.here) << (graph->get_is_reverse(frame.here) ? "-" : "+") 
                     << " into component with head " << graph->get_id(frame_head) << (graph->get_is_reverse(frame_head) ? "-" : "+") << endl;
 #endif
                 
-                auto frame_it = records.find(frame_head);
-                if (frame_it == records.end()) {
+                if (!records[frame_component].visited) {
                     // First visit to here.
                     
 #ifdef debug
@@ -618,12 +1302,12 @@ pair<vector<pair<size_t, vector<handle_t>>>, unordered_map<handle_t, handle_t>>
 #endif
                     
                     // Mark visited
-                    frame_it = records.emplace_hint(frame_it, frame_head, DFSRecord());
+                    records[frame_component].visited = true;
                     // And fill it in with default references.
                     // Remember how to get back to the parent
-                    frame_it->second.parent_edge = graph->flip(frame.here);
+                    records[frame_component].parent_edge = graph->flip(frame.here);
                     // Say there's no known leaf-leaf path converging anywhere under it yet.
-                    frame_it->second.longest_subtree_path_root = frame_head;
+                    records[frame_component].longest_subtree_path_root = frame_head;
                     
                     // Queue up edges
                     for_each_member(frame_head, [&](handle_t member) {
@@ -645,27 +1329,28 @@ pair<vector<pair<size_t, vector<handle_t>>>, unordered_map<handle_t, handle_t>>
                     });
                 }
                 
-                auto& record = frame_it->second;
+                auto& record = records[frame_component];
                 
                 if (!frame.todo.empty()) {
                     // Now do an edge
                     handle_t edge_into = frame.todo.back();
-                    handle_t connected_head = find(edge_into);
+                    size_t connected_component = component_number(find(edge_into));
                     frame.todo.pop_back();
                     
 #ifdef debug
                     cerr << "\tFollowing " << graph->get_id(edge_into) << (graph->get_is_reverse(edge_into) ? "-" : "+") << endl;
 #endif
                     
-                    if (!records.count(connected_head)) {
+                    if (!records[connected_component].visited) {
                         // Forward edge. Recurse.
                         
 #ifdef debug
-                        cerr << "\t\tReaches unvisited " << graph->get_id(connected_head) << (graph->get_is_reverse(connected_head) ? "-" : "+") << "; Recurse!" << endl;
+                        cerr << "\t\tReaches unvisited component " << connected_component << "; Recurse!" << endl;
 #endif
                         
                         stack.emplace_back();
                         stack.back().here = edge_into;
+                        stack.back().component = connected_component;
                     }
                 } else {
                     // No children left.
@@ -674,83 +1359,22 @@ pair<vector<pair<size_t, vector<handle_t>>>, unordered_map<handle_t, handle_t>>
                     cerr << "\tDone with all children." << endl;
 #endif
                     
-                    // Did any of our children decalre themselves deepest?
-                    // Or do we have no children.
-                    auto deepest_child_edge_it = deepest_child_edge.find(frame_head);
-                    
                     if (stack.size() > 1) {
                         // If we have a parent
                         auto& parent_frame = stack[stack.size() - 2];
                         auto parent_head = find(parent_frame.here);
-                        auto& parent_record = records[parent_head];
+                        auto& parent_record = records[parent_frame.component];
                         
-                        // The length of the path to a leaf will involve the edge from the parent to here.
-                        record.leaf_path_length = graph->get_length(frame.here);
+                        // The length of the path to a leaf will involve the
+                        // edge from the parent to here, and the path through
+                        // our deepest child if we have one.
+                        record.leaf_path_length = graph->get_length(frame.here) + record.deepest_child_length;
                         
 #ifdef debug
                         cerr << "\t\tLength of path to deepest leaf is " << record.leaf_path_length << " bp" << endl;
 #endif
                         
-                        if (deepest_child_edge_it != deepest_child_edge.end()) {
-                            // And if we have a child to go on with, we add the length of that path
-                            record.leaf_path_length += records[find(deepest_child_edge_it->second)].leaf_path_length;
-                            
-#ifdef debug
-                                cerr << "\t\t\tPlus length from here to leaf via "
-                                    << graph->get_id(deepest_child_edge_it->second) << (graph->get_is_reverse(deepest_child_edge_it->second) ? "-" : "+")
-                                    << " for " << record.leaf_path_length << " bp total" << endl;
-#endif
-                            
-                        }
-                        
-                        // Fill in deepest_child_edge for the parent if not filled in already, or if we beat what's there.
-                        // Also maintain parent's second_deepest_child_edge.
-                        auto parent_deepest_child_it = deepest_child_edge.find(parent_head);
-                        if (parent_deepest_child_it == deepest_child_edge.end()) {
-                        
-#ifdef debug
-                            cerr << "\t\tWe are our parent's deepest child by default!" << endl;
-#endif
-                        
-                            // Emplace in the map where we didn't find anything.
-                            deepest_child_edge.emplace_hint(parent_deepest_child_it, parent_head, frame.here);
-                        } else if(records[find(parent_deepest_child_it->second)].leaf_path_length < record.leaf_path_length) {
-                            // We are longer than what's there now
-                            
-#ifdef debug
-                            cerr << "\t\tWe are our parent's new deepest child!" << endl;
-#endif
-                            
-                            // Demote what's there to second-best
-                            parent_record.second_deepest_child_edge = parent_deepest_child_it->second;
-                            parent_record.has_second_deepest_child = true;
-                            
-#ifdef debug
-                            cerr << "\t\t\tWe demote "
-                                << graph->get_id(parent_record.second_deepest_child_edge) << (graph->get_is_reverse(parent_record.second_deepest_child_edge) ? "-" : "+")
-                                << " to second-deepest child" << endl;
-#endif
-                            
-                            // Replace the value we found
-                            parent_deepest_child_it->second = frame.here;
-                        } else if (!parent_record.has_second_deepest_child) {
-                            
-#ifdef debug
-                            cerr << "\t\tWe are our parent's second deepest child by default!" << endl;
-#endif
-                            
-                            // There's no second-deepest recorded so we must be it.
-                            parent_record.second_deepest_child_edge = frame.here;
-                            parent_record.has_second_deepest_child = true;
-                        } else if (records[find(parent_record.second_deepest_child_edge)].leaf_path_length < record.leaf_path_length) {
-                            
-#ifdef debug
-                            cerr << "\t\tWe are our parent's new second deepest child!" << endl;
-#endif
-                            
-                            // We are a new second deepest child.
-                            parent_record.second_deepest_child_edge = frame.here;
-                        }
+                        mix_child(parent_head, parent_record, frame.here, record.leaf_path_length);
                     }
                     
                     // The length of the longest leaf-leaf path converging at or under any child (if any) is in record.longest_subtree_path_length.
@@ -760,14 +1384,8 @@ pair<vector<pair<size_t, vector<handle_t>>>, unordered_map<handle_t, handle_t>>
                         // If we're the root and there *isn't* a second incoming leaf-leaf path, we are ourselves a leaf.
                         
                         // Grab the length of the longest leaf-leaf path converging exactly here.
-                        // TODO: can we not look up the deepest child's record again?
-                        size_t longest_here_path_length = 0;
-                        if (deepest_child_edge_it != deepest_child_edge.end()) {
-                            longest_here_path_length += records[find(deepest_child_edge_it->second)].leaf_path_length;
-                        }
-                        if (record.has_second_deepest_child) {
-                            longest_here_path_length += records[find(record.second_deepest_child_edge)].leaf_path_length;
-                        }
+                        // Lengths are 0 for children we don't have.
+                        size_t longest_here_path_length = record.deepest_child_length + record.second_deepest_child_length;
                         
 #ifdef debug
                         cerr << "\t\tPaths converge here with total length " << longest_here_path_length << " bp" << endl;
@@ -793,10 +1411,9 @@ pair<vector<pair<size_t, vector<handle_t>>>, unordered_map<handle_t, handle_t>>
                     if (stack.size() > 1 && record.longest_subtree_path_length > 0) {
                         // We have a leaf-leaf path converging at or under here, and we have a parent.
                         // TODO: we assume leaf-leaf paths are nonzero length here.
-                        // TODO: save searching up the parent record again
                         auto& parent_frame = stack[stack.size() - 2];
                         auto parent_head = find(parent_frame.here);
-                        auto& parent_record = records[parent_head];
+                        auto& parent_record = records[parent_frame.component];
                         
                         // Max our longest leaf-leaf path in against the paths contributed by previous children.
                         if (parent_record.longest_subtree_path_root == parent_head ||
@@ -830,11 +1447,11 @@ pair<vector<pair<size_t, vector<handle_t>>>, unordered_map<handle_t, handle_t>>
 #endif
                             
                             // We need to record the longest tree path.
-                            longest_tree_paths.emplace_back();
-                            longest_tree_paths.back().first = record.longest_subtree_path_length;
-                            auto& path = longest_tree_paths.back().second;
+                            found_paths.emplace_back();
+                            found_paths.back().first = record.longest_subtree_path_length;
+                            auto& path = found_paths.back().second;
                             
-                            auto& path_root_frame = records[record.longest_subtree_path_root];
+                            auto& path_root_frame = records[component_number(record.longest_subtree_path_root)];
                             
                             if (path_root_frame.has_second_deepest_child) {
                                 // This is an actual convergence point
@@ -846,9 +1463,9 @@ pair<vector<pair<size_t, vector<handle_t>>>, unordered_map<handle_t, handle_t>>
                                 // Collect the whole path down the second deepest child
                                 path.push_back(path_root_frame.second_deepest_child_edge);
                                 auto path_trace_it = deepest_child_edge.find(find(path.back()));
-                                while (path_trace_it != deepest_child_edge.end()) {
+                                while (path_trace_it != nullptr) {
                                     // Follow the deepest child relationships until they run out.
-                                    path.push_back(path_trace_it->second);
+                                    path.push_back(*path_trace_it);
                                     path_trace_it = deepest_child_edge.find(find(path.back()));
                                 }
                                 // Reverse what's there and flip all the edges
@@ -877,9 +1494,9 @@ pair<vector<pair<size_t, vector<handle_t>>>, unordered_map<handle_t, handle_t>>
                                 // Trace the actual longest path from root to leaf and add it on
                                 path.push_back(deepest_child_edge[record.longest_subtree_path_root]);
                                 auto path_trace_it = deepest_child_edge.find(find(path.back()));
-                                while (path_trace_it != deepest_child_edge.end()) {
+                                while (path_trace_it != nullptr) {
                                     // Follow the deepest child relationships until they run out.
-                                    path.push_back(path_trace_it->second);
+                                    path.push_back(*path_trace_it);
                                     path_trace_it = deepest_child_edge.find(find(path.back()));
                                 }
                             }
@@ -898,7 +1515,7 @@ pair<vector<pair<size_t, vector<handle_t>>>, unordered_map<handle_t, handle_t>>
                             while (cursor != frame_head) {
                                 // Walk up the parent pointers to the traversal root and stack up the heads.
                                 // We may get nothing if the root happened to already be on the longest leaf-leaf path.
-                                auto& cursor_record = records[cursor];
+                                auto& cursor_record = records[component_number(cursor)];
                                 convergence_to_old_root.push_back(cursor_record.parent_edge);
                                 cursor = find(cursor_record.parent_edge);
                             }
@@ -908,78 +1525,50 @@ pair<vector<pair<size_t, vector<handle_t>>>, unordered_map<handle_t, handle_t>>
 #endif
                             
                             while (!convergence_to_old_root.empty()) {
-                                // Then go down that stack
+                                // Then go down that stack, from the old root
+                                // towards the new one. Each step makes the
+                                // old parent into a child, and only needs the
+                                // records of the two components involved, so
+                                // rerooting is linear in the path length.
                                 
                                 // Define new child and parent
                                 handle_t parent_child_edge = convergence_to_old_root.back();
                                 handle_t child_head = find(parent_child_edge);
                                 handle_t parent_head = find(graph->flip(parent_child_edge));
                                 
-                                // TODO: find a way to demote parent to child here on each iteration
-                                auto& child_record = records[child_head];
-                                auto& parent_record = records[parent_head];
+                                auto& child_record = records[component_number(child_head)];
+                                auto& parent_record = records[component_number(parent_head)];
                                 
                                 // If the deepest child of the child is actually the parent, disqualify it
-                                deepest_child_edge_it = deepest_child_edge.find(child_head);
+                                auto child_deepest_child_it = deepest_child_edge.find(child_head);
                                 
-                                if (deepest_child_edge_it != deepest_child_edge.end() && find(deepest_child_edge_it->second) == parent_head) {
+                                if (child_deepest_child_it != nullptr && find(*child_deepest_child_it) == parent_head) {
                                     // The parent was the child's deepest child. Can't have that.
                                     if (child_record.has_second_deepest_child) {
                                         // Promote the second deepest child.
-                                        deepest_child_edge_it->second = child_record.second_deepest_child_edge;
+                                        *child_deepest_child_it = child_record.second_deepest_child_edge;
+                                        child_record.deepest_child_length = child_record.second_deepest_child_length;
                                         child_record.has_second_deepest_child = false;
+                                        child_record.second_deepest_child_length = 0;
                                     } else {
                                         // No more deepest child
-                                        deepest_child_edge.erase(deepest_child_edge_it);
-                                        deepest_child_edge_it = deepest_child_edge.end();
+                                        deepest_child_edge.erase(child_head);
+                                        child_record.deepest_child_length = 0;
                                     }
                                 }
                                 
                                 // The child may not have had a parent before.
                                 // So we need to fill in its longest leaf path
-                                // length counting its new parent edge.
-                                
-                                // But we know all its children are done.
-                                
-                                // The length of the path to a leaf will involve the edge from the parent to the child
-                                child_record.leaf_path_length = graph->get_length(parent_child_edge);
-                                
-                                if (deepest_child_edge_it != deepest_child_edge.end()) {
-                                    // And if we have a child to go on with, we add the length of that path
-                                    child_record.leaf_path_length += records[find(deepest_child_edge_it->second)].leaf_path_length;
-                                }
+                                // length counting its new parent edge. But we
+                                // know all its children are done.
+                                child_record.leaf_path_length = graph->get_length(parent_child_edge) + child_record.deepest_child_length;
                                 
                                 // Now we have to mix ourselves into the parent.
                                 // We do it the same way as normal. Both the deepest and second-deepest child of the parent can't be the grandparent.
                                 // So if they both beat us we can't be the real deepest child.
                                 // If we beat the second deepest child, and the original deepest child gets disqualified for being the grandparent, we become the parent's deepest child.
                                 // And if we beat both it doesn't matter whether either gets disqualified, because we win.
-                                
-                                // TODO: deduplicate code with the original DFS?
-                                
-                                // Fill in deepest_child_edge for the parent if not filled in already, or if we beat what's there.
-                                // Also maintain parent's second_deepest_child_edge.
-                                auto parent_deepest_child_it = deepest_child_edge.find(parent_head);
-                                if (parent_deepest_child_it == deepest_child_edge.end()) {
-                                    // Emplace in the map where we didn't find anything.
-                                    deepest_child_edge.emplace_hint(parent_deepest_child_it, parent_head, parent_child_edge);
-                                } else if(records[find(parent_deepest_child_it->second)].leaf_path_length < child_record.leaf_path_length) {
-                                    // We are longer than what's there now
-                                    
-                                    // Demote what's there to second-best
-                                    parent_record.second_deepest_child_edge = parent_deepest_child_it->second;
-                                    parent_record.has_second_deepest_child = true;
-                                    
-                                    // Replace the value we found
-                                    parent_deepest_child_it->second = parent_child_edge;
-                                } else if (!parent_record.has_second_deepest_child) {
-                                    // There's no second-deepest recorded so we must be it.
-                                    parent_record.second_deepest_child_edge = parent_child_edge;
-                                    parent_record.has_second_deepest_child = true;
-                                } else if (records[find(parent_record.second_deepest_child_edge)].leaf_path_length < child_record.leaf_path_length) {
-                                    // We are a new second deepest child.
-                                    parent_record.second_deepest_child_edge = parent_child_edge;
-                                }
+                                mix_child(parent_head, parent_record, parent_child_edge, child_record.leaf_path_length);
                                
                                 // Now the new child, if its path is deep enough, is the parent's new deepest or second deepest child edge.
                                 // Go up a level, disqualify the grandparent, and see who wins.
@@ -997,11 +1586,11 @@ pair<vector<pair<size_t, vector<handle_t>>>, unordered_map<handle_t, handle_t>>
 
                             if (path.empty()) {
                                 // If the leaf-leaf path is empty, stick in a handle so we can actually find the single leaf in the bridge forest.
-                                assert(longest_tree_paths.back().first == 0);
+                                assert(found_paths.back().first == 0);
                                 path.push_back(traversal_root);
                             } else {
                                 // If anything is on the path, we shouldn't have 0 length.
-                                assert(longest_tree_paths.back().first != 0);
+                                assert(found_paths.back().first != 0);
                             }
                             
                         }
@@ -1016,18 +1605,47 @@ pair<vector<pair<size_t, vector<handle_t>>>, unordered_map<handle_t, handle_t>>
         }
     };
     
+    // Trees in the forest don't interact, so we work out where we would root
+    // each one and then search them all in parallel.
+    vector<size_t> connected_component_of;
+    vector<handle_t> component_roots = connected_components(connected_component_of);
+    vector<bool> rooted(component_roots.size(), false);
+    vector<pair<handle_t, size_t>> traversal_roots;
+    traversal_roots.reserve(component_roots.size());
+    
     for (auto it = longest_simple_cycles.begin(); it != longest_simple_cycles.end(); ++it) {
         // Try it from the head of the component that each longest input simple
         // cycle got merged into. If we end up using that longest cycle to root
         // this component, we will have everything pointing the right way
         // already.
-        try_root(find(it->second), it->first);
+        handle_t cycle_head = find(it->second);
+        size_t tree = connected_component_of[component_number(cycle_head)];
+        if (!rooted[tree]) {
+            rooted[tree] = true;
+            traversal_roots.emplace_back(cycle_head, it->first);
+        }
     }
     
-    // And then try it on every head in general to mop up anything without a simple cycle in it
-    for_each_head([&](handle_t head) {
-        try_root(head, 0);
-    });
+    for (size_t tree = 0; tree < component_roots.size(); tree++) {
+        // And then try it on the first head of each tree in general to mop up
+        // anything without a simple cycle in it
+        if (!rooted[tree]) {
+            traversal_roots.emplace_back(component_roots[tree], 0);
+        }
+    }
+    
+    // Collect the paths for each root separately, so we can report them in
+    // root order.
+    vector<vector<pair<size_t, vector<handle_t>>>> root_paths(traversal_roots.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < traversal_roots.size(); i++) {
+        try_root(traversal_roots[i].first, traversal_roots[i].second, root_paths[i]);
+    }
+    for (auto& paths : root_paths) {
+        for (auto& path : paths) {
+            longest_tree_paths.emplace_back(std::move(path));
+        }
+    }
     
     // The DFS records die with this function, but the rewritten deepest child
     // edges survive and let us root snarls having only their incoming ends.
@@ -1036,10 +1654,10 @@ pair<vector<pair<size_t, vector<handle_t>>>, unordered_map<handle_t, handle_t>>
     
 #ifdef debug
     cerr << "Edges to deepest children in bridge forest:" << endl;
-    for (auto& kv : deepest_child_edge) {
-        cerr << "\t" << graph->get_id(kv.first) << (graph->get_is_reverse(kv.first) ? "-" : "+")
-            << " -> " << graph->get_id(kv.second) << (graph->get_is_reverse(kv.second) ? "-" : "+") << endl;
-    }
+    deepest_child_edge.for_each([&](handle_t from, handle_t to) {
+        cerr << "\t" << graph->get_id(from) << (graph->get_is_reverse(from) ? "-" : "+")
+            << " -> " << graph->get_id(to) << (graph->get_is_reverse(to) ? "-" : "+") << endl;
+    });
 #endif
     
     return to_return;
@@ -1067,16 +1685,16 @@ void IntegratedSnarlFinder::traverse_decomposition(const function<void(handle_t)
     cerr << "Ranking graph handles." << endl;
 #endif
     
-    // First we need to ensure that our graph has dense handle ranks
-    bdsg::RankedOverlayHelper overlay_helper;
-    auto ranked_graph = overlay_helper.apply(graph);
+    // First we need dense handle ranks. We only build an overlay if the
+    // node IDs are too sparse to rank directly.
+    DenseHandleRanking ranking(graph);
     
 #ifdef debug
     cerr << "Finding snarls." << endl;
 #endif
     
     // We need a union-find over the adjacency components of the graph, in which we will build the cactus graph.
-    MergedAdjacencyGraph cactus(ranked_graph);
+    MergedAdjacencyGraph cactus(graph, &ranking);
     
 #ifdef debug
     cerr << "Base adjacency components:" << endl;
@@ -1090,51 +1708,10 @@ void IntegratedSnarlFinder::traverse_decomposition(const function<void(handle_t)
 #endif
     
     // Now we need to do the 3 edge connected component merging, using Tsin's algorithm.
-    // We don't really have a good dense rank space on the adjacency components, so we use the general version.
-    // TODO: Somehow have a nice dense rank space on components. Can we just use backing graph ranks and hope it's dense enough?
-    // We represent each adjacency component (node) by its heading handle.
-#ifdef debug
-    size_t tecc_id = 0;
-#endif
-    // Buffer merges until the algorithm is done.
-    vector<pair<handle_t, handle_t>> merge_list;
-    algorithms::three_edge_connected_component_merges<handle_t>([&](const function<void(handle_t)>& emit_node) {
-        // Feed all the handles that head adjacency components into the algorithm
-        cactus.for_each_head([&](handle_t head) {
-#ifdef debug
-            cerr << "Three edge component node " << tecc_id << " is head " << graph->get_id(head) << (graph->get_is_reverse(head) ? "-" : "+") << endl;
-            tecc_id++;
-#endif
-            emit_node(head);
-        });
-    }, [&](handle_t node, const function<void(handle_t)>& emit_edge) {
-        // When asked for edges, don't deduplicate or filter. We want all multi-edges.
-        cactus.for_each_member(node, [&](handle_t other_member) {
-            // For each handle in the adjacency component that this handle is heading (including the head)
-            
-            // Follow as an edge again, by flipping
-            handle_t member_connected_head = cactus.find(graph->flip(other_member));
-            
-            if (member_connected_head == node && graph->get_is_reverse(other_member)) {
-                // For self loops, only follow them in one direction. Skip in the other.
-                return;
-            }
-            
-            // Announce it. Multi-edges are OK.
-            emit_edge(member_connected_head);
-        });
-    }, [&](handle_t a, handle_t b) {
-        // Now we got a merge to create the 3 edge connected components.
-        // We can't actually do the merge now, because we can't let the merges
-        // be visible to the algorithm while it is working. 
-        merge_list.emplace_back(a, b);
-    });
-    
-    // Now execute the merges, since the algorithm is done looking at the graph.
-    for (auto& ab : merge_list) {
-        cactus.merge(ab.first, ab.second);
-    }
-    merge_list.clear();
+    // The cactus graph ranks its own components so it can use the dense version.
+    cactus.merge_three_edge_connected_components();
+    // We will need to look at the cactus graph's components a lot now.
+    cactus.freeze();
     
     // Now our 3-edge-connected components have been condensed, and we have a proper Cactus graph.
     
@@ -1155,14 +1732,15 @@ void IntegratedSnarlFinder::traverse_decomposition(const function<void(handle_t)
 #endif
     
     // Get cycle information: longest cycle in each connected component, and next edge along cycle for each edge (in one orientation)
-    pair<vector<pair<size_t, handle_t>>, unordered_map<handle_t, handle_t>> cycles = cactus.cycles_in_cactus();
+    pair<vector<pair<size_t, handle_t>>, DenseHandleMap<handle_t>> cycles = cactus.cycles_in_cactus();
     auto& longest_cycles = cycles.first;
     auto& next_along_cycle = cycles.second;
     
-    for (auto& kv : next_along_cycle) {
+    next_along_cycle.for_each([&](handle_t from, handle_t to) {
         // Merge along all cycles in the bridge forest
-        forest.merge(kv.first, kv.second);
-    }
+        forest.merge(from, to);
+    });
+    forest.freeze();
 
 #ifdef debug
     cerr << "Bridge forest:" << endl;
@@ -1185,7 +1763,7 @@ void IntegratedSnarlFinder::traverse_decomposition(const function<void(handle_t)
     //
     // For empty leaf-leaf paths, will emit a single node "path" with a length
     // of 0.
-    pair<vector<pair<size_t, vector<handle_t>>>, unordered_map<handle_t, handle_t>> forest_paths = forest.longest_paths_in_forest(longest_cycles);
+    pair<vector<pair<size_t, vector<handle_t>>>, DenseHandleMap<handle_t>> forest_paths = forest.longest_paths_in_forest(longest_cycles);
     auto& longest_paths = forest_paths.first;
     auto& towards_deepest_leaf = forest_paths.second;
     
@@ -1216,241 +1794,271 @@ void IntegratedSnarlFinder::traverse_decomposition(const function<void(handle_t)
 /**
  * A set over the nodes in a handle graph.
  * All queries automatically ignore orientation.
+ * Stored as a byte array over dense node ranks, so different threads can
+ * insert different nodes at the same time.
  */
 class HandleGraphNodeSet {
 private:
-    unordered_set<handle_t> visited;
-    const HandleGraph* graph;
+    vector<uint8_t> visited;
+    const DenseHandleRanking* ranking;
 public:
     /**
-     * Make a new set over the nodes of the given graph.
+     * Make a new set over the nodes of the graph with the given handle
+     * ranking.
      */
-    inline HandleGraphNodeSet(const HandleGraph* graph): graph(graph) {
+    inline HandleGraphNodeSet(const DenseHandleRanking* ranking): visited(ranking->size() / 2, 0), ranking(ranking) {
         // Nothing to do
     }
     
     /**
-     * Get the number of nodes in the set.
+     * Get the number of nodes in the set. Takes time linear in the size of
+     * the graph.
      */
     inline size_t size() const {
-        return visited.size();
+        return std::count(visited.begin(), visited.end(), 1);
     }
     
     /**
      * Add a node to the set, given a handle to either orientation.
      */
     inline void insert(const handle_t& here) {
-        visited.insert(graph->forward(here));
+        // Both orientations of a node share a rank, divided by 2.
+        visited[ranking->rank(here) / 2] = 1;
     }
     
     /**
      * Return whether a node is in the set, given a handle to either orientation.
      */
     inline bool count(const handle_t& here) const {
-        return visited.count(graph->forward(here));
+        return visited[ranking->rank(here) / 2];
     }
 };
 
 void IntegratedSnarlFinder::traverse_computed_decomposition(MergedAdjacencyGraph& cactus,
     const MergedAdjacencyGraph& forest,
     vector<pair<size_t, vector<handle_t>>>& longest_paths,
-    unordered_map<handle_t, handle_t>& towards_deepest_leaf,
+    DenseHandleMap<handle_t>& towards_deepest_leaf,
     vector<pair<size_t, handle_t>>& longest_cycles,
-    unordered_map<handle_t, handle_t>& next_along_cycle,
+    DenseHandleMap<handle_t>& next_along_cycle,
     const function<void(handle_t)>& begin_chain, const function<void(handle_t)>& end_chain,
     const function<void(handle_t)>& begin_snarl, const function<void(handle_t)>& end_snarl) const {
   
     // Now, keep a set of all the edges that have found a place in the decomposition.
     // Ignore handle orientation.
     // Because we don't want to mess up orientations, we only access the set through accessors.
-    HandleGraphNodeSet visited(graph);
+    HandleGraphNodeSet visited(&cactus.get_ranking());
     
 #ifdef debug
     cerr << "Traversing cactus graph..." << endl;
 #endif
 
-    // How many handle graph nodes need to be decomposed?
-    size_t to_decompose = graph->get_node_count();
-    while(visited.size() < to_decompose) {
-        // While we haven't touched everything
+    // Work out which longest path or cycle roots each connected component,
+    // in the order we will report them. We take the longest roots first,
+    // with paths winning ties, and skip any root for a component that is
+    // already rooted. Each root is a flag for whether it is a path, and an
+    // index in longest_paths or longest_cycles.
+    vector<size_t> tree_of;
+    vector<handle_t> trees = forest.connected_components(tree_of);
+    vector<bool> rooted(trees.size(), false);
+    vector<pair<bool, size_t>> roots;
+    roots.reserve(trees.size());
+    size_t paths_left = longest_paths.size();
+    size_t cycles_left = longest_cycles.size();
+    while (paths_left > 0 || cycles_left > 0) {
+        bool use_path = cycles_left == 0 || (paths_left > 0 && longest_cycles[cycles_left - 1].first <= longest_paths[paths_left - 1].first);
         
-#ifdef debug
-        if (!longest_cycles.empty()) {
-            cerr << "Longest cycle: " << longest_cycles.back().first << " bp" << endl;
+        handle_t root_edge;
+        if (use_path) {
+            // It should not be empty. It should at least have a single bridge forest node to visit.
+            assert(!longest_paths[paths_left - 1].second.empty());
+            root_edge = longest_paths[paths_left - 1].second.front();
+        } else {
+            root_edge = longest_cycles[cycles_left - 1].second;
         }
         
-        if (!longest_paths.empty()) {
-            cerr << "Longest path: " << longest_paths.back().first << " bp" << endl;
+        size_t tree = tree_of[forest.component_number(forest.find(root_edge))];
+        if (!rooted[tree]) {
+            // This connected component isn't already covered.
+            rooted[tree] = true;
+            roots.emplace_back(use_path, use_path ? paths_left - 1 : cycles_left - 1);
         }
-#endif
         
-        // We have a stack.
-        struct SnarlChainFrame {
-            // Set to true if this is a snarl being generated, and false if it is a chain.
-            bool is_snarl = true;
-            
-            // Set to true if the children have already been enumerated.
-            // If we get back to a frame, and this is true, and todo is empty, we are done with the frame.
-            bool saw_children = false;
-            
-            // Into and out-of edges of this snarl or chain, within its parent.
-            // Only set if we aren't the root frame on the stack.
-            pair<handle_t, handle_t> bounds;
-            
-            // Edges denoting children to process.
-            // If we are a snarl, an entry may be a bridge edge reading into us.
-            // If so, we will transform it into a cycle.
-            // If we are a snarl, an entry may be a cycle edge reading into us (with the next edge around the cycle reading out).
-            // If so, we will recurse on the chain.
-            // If we are a chain, an entry may be an edge reading into a child snarl.
-            // If so, we will find the other side of the snarl and recurse on the snarl.
-            vector<handle_t> todo;
-        };
+        (use_path ? paths_left : cycles_left)--;
+    }
+    
+    // Different connected components may merge their own parts of the
+    // cactus graph at the same time, so it can't keep a snapshot.
+    cactus.thaw();
+    
+    // We have a stack.
+    struct SnarlChainFrame {
+        // Set to true if this is a snarl being generated, and false if it is a chain.
+        bool is_snarl = true;
+        
+        // Set to true if the children have already been enumerated.
+        // If we get back to a frame, and this is true, and todo is empty, we are done with the frame.
+        bool saw_children = false;
+        
+        // Into and out-of edges of this snarl or chain, within its parent.
+        // Only set if we aren't the root frame on the stack.
+        pair<handle_t, handle_t> bounds;
+        
+        // Edges denoting children to process.
+        // If we are a snarl, an entry may be a bridge edge reading into us.
+        // If so, we will transform it into a cycle.
+        // If we are a snarl, an entry may be a cycle edge reading into us (with the next edge around the cycle reading out).
+        // If so, we will recurse on the chain.
+        // If we are a chain, an entry may be an edge reading into a child snarl.
+        // If so, we will find the other side of the snarl and recurse on the snarl.
+        vector<handle_t> todo;
+    };
+    
+    // We have a function to walk the decomposition of the connected
+    // component with the given root, and report it to the given callbacks.
+    // Only touches the parts of the shared structures that belong to that
+    // connected component.
+    auto decompose_root = [&](const pair<bool, size_t>& root,
+        const function<void(handle_t)>& begin_chain, const function<void(handle_t)>& end_chain,
+        const function<void(handle_t)>& begin_snarl, const function<void(handle_t)>& end_snarl) {
+        
         vector<SnarlChainFrame> stack;
         
-        if (longest_cycles.empty() || (!longest_paths.empty() && longest_cycles.back().first <= longest_paths.back().first)) {
-            // There should be a path still
-            assert(!longest_paths.empty());
-            // It should not be empty. It should at least have a single bridge forest node to visit.
-            assert(!longest_paths.back().second.empty());
+        if (root.first) {
+            // We will root on a tip-tip path for its connected component,
+            // because there isn't a longer cycle.
+            auto& longest_path = longest_paths[root.second];
+            
+#ifdef debug
+            cerr << "Longest path: " << longest_path.first << " bp" << endl;
+#endif
             
-            // We will root on a tip-tip path for its connected component, if
-            // not already covered, because there isn't a longer cycle.
+            handle_t first_edge = longest_path.second.front();
             
-            if (!visited.count(longest_paths.back().second.front())) {
-                // This connected component isn't already covered.
+            if (longest_path.first == 0) {
+                // This is a 0-length path, but we want to root the decomposition here.
+                // This bridge tree has no nonempty cycles and no bridge edges. It's just all one adjacency component.
+                // All contents spill out into the root snarl as contained nodes.
                 
-                handle_t first_edge = longest_paths.back().second.front();
+#ifdef debug
+                cerr << "Single node bridge tree with no real cycles for "
+                    << graph->get_id(first_edge) << (graph->get_is_reverse(first_edge) ? "-" : "+") << endl;
+                    
+                cerr << "\tSpilling contents into root snarl." << endl;
+#endif
                 
-                if (longest_paths.back().first == 0) {
-                    // This is a 0-length path, but we want to root the decomposition here.
-                    // This bridge tree has no nonempty cycles and no bridge edges. It's just all one adjacency component.
-                    // All contents spill out into the root snarl as contained nodes.
+                cactus.for_each_member(cactus.find(first_edge), [&](handle_t inbound) {
+                    // The contents are all self loops
+                    assert(cactus.find(inbound) == cactus.find(graph->flip(inbound)));
+                    if (!graph->get_is_reverse(inbound)) {
+                        // We only want them forward so each becomes only one empty chain.
                     
 #ifdef debug
-                    cerr << "Single node bridge tree with no real cycles for "
-                        << graph->get_id(first_edge) << (graph->get_is_reverse(first_edge) ? "-" : "+") << endl;
-                        
-                    cerr << "\tSpilling contents into root snarl." << endl;
+                        cerr << "\t\tContain edge " << graph->get_id(inbound) << (graph->get_is_reverse(inbound) ? "-" : "+") << endl;
 #endif
                     
-                    cactus.for_each_member(cactus.find(first_edge), [&](handle_t inbound) {
-                        // The contents are all self loops
-                        assert(cactus.find(inbound) == cactus.find(graph->flip(inbound)));
-                        if (!graph->get_is_reverse(inbound)) {
-                            // We only want them forward so each becomes only one empty chain.
+                        begin_chain(inbound);
+                        end_chain(inbound);
                         
+                        visited.insert(inbound);
+                    }
+                });
+            } else {
+            
+                // This is a real path between distinct bridge edge tree leaves
+           
 #ifdef debug
-                            cerr << "\t\tContain edge " << graph->get_id(inbound) << (graph->get_is_reverse(inbound) ? "-" : "+") << endl;
+                cerr << "Rooting component at tip-tip path starting with " << graph->get_id(first_edge) << (graph->get_is_reverse(first_edge) ? "-" : "+") << endl;
 #endif
-                        
-                            begin_chain(inbound);
-                            end_chain(inbound);
-                            
-                            visited.insert(inbound);
-                        }
-                    });
-                } else {
                 
-                    // This is a real path between distinct bridge edge tree leaves
-               
+                for (size_t i = 1; i < longest_path.second.size(); i++) {
+                    // Rewrite the deepest bridge graph leaf path map to point from one end of the tip-tip path to the other
+                    // TODO: bump this down into the bridge path finding function
+                    
+                    handle_t prev_path_edge = longest_path.second[i - 1];
+                    handle_t prev_head = forest.find(prev_path_edge);
+                    handle_t next_path_edge = longest_path.second[i];
+                    
+                    towards_deepest_leaf[prev_head] = next_path_edge;
+                    
 #ifdef debug
-                    cerr << "Rooting component at tip-tip path starting with " << graph->get_id(first_edge) << (graph->get_is_reverse(first_edge) ? "-" : "+") << endl;
+                    cerr << "\tEnforce leaf path goes " << graph->get_id(prev_path_edge) << (graph->get_is_reverse(prev_path_edge) ? "-" : "+")
+                        << " with head " << graph->get_id(prev_head) << (graph->get_is_reverse(prev_head) ? "-" : "+")
+                        << " to next edge " << graph->get_id(next_path_edge) << (graph->get_is_reverse(next_path_edge) ? "-" : "+") << endl;
 #endif
                     
-                    for (size_t i = 1; i < longest_paths.back().second.size(); i++) {
-                        // Rewrite the deepest bridge graph leaf path map to point from one end of the tip-tip path to the other
-                        // TODO: bump this down into the bridge path finding function
-                        
-                        handle_t prev_path_edge = longest_paths.back().second[i - 1];
-                        handle_t prev_head = forest.find(prev_path_edge);
-                        handle_t next_path_edge = longest_paths.back().second[i];
-                        
-                        towards_deepest_leaf[prev_head] = next_path_edge;
-                        
+                }
+            
+                // Stack up a root/null snarl containing this bridge edge.
+                // Remember to queue it facing inward, toward the new new root at the start of the path.
+                stack.emplace_back();
+                stack.back().is_snarl = true;
+                stack.back().todo.push_back(graph->flip(first_edge));
+                
 #ifdef debug
-                        cerr << "\tEnforce leaf path goes " << graph->get_id(prev_path_edge) << (graph->get_is_reverse(prev_path_edge) ? "-" : "+")
-                            << " with head " << graph->get_id(prev_head) << (graph->get_is_reverse(prev_head) ? "-" : "+")
-                            << " to next edge " << graph->get_id(next_path_edge) << (graph->get_is_reverse(next_path_edge) ? "-" : "+") << endl;
+                cerr << "\tPut cycles and self edges at tip into root snarl" << endl;
 #endif
-                        
+                
+                // Find all the cycles and self edges that are also here and make sure to do them. Connectivity will be in the root snarl.
+                cactus.for_each_member(cactus.find(graph->flip(first_edge)), [&](handle_t inbound) {
+                    if (inbound == graph->flip(first_edge)) {
+                        // Skip the one bridge edge we started with
+                        return;
                     }
                 
-                    // Stack up a root/null snarl containing this bridge edge.
-                    // Remember to queue it facing inward, toward the new new root at the start of the path.
-                    stack.emplace_back();
-                    stack.back().is_snarl = true;
-                    stack.back().todo.push_back(graph->flip(first_edge));
-                    
-#ifdef debug
-                    cerr << "\tPut cycles and self edges at tip into root snarl" << endl;
-#endif
-                    
-                    // Find all the cycles and self edges that are also here and make sure to do them. Connectivity will be in the root snarl.
-                    cactus.for_each_member(cactus.find(graph->flip(first_edge)), [&](handle_t inbound) {
-                        if (inbound == graph->flip(first_edge)) {
-                            // Skip the one bridge edge we started with
-                            return;
-                        }
-                    
 #ifdef debug
-                        cerr << "\t\tLook at edge " << graph->get_id(inbound) << (graph->get_is_reverse(inbound) ? "-" : "+") << " on " << next_along_cycle.count(inbound) << " cycles" << endl;
+                    cerr << "\t\tLook at edge " << graph->get_id(inbound) << (graph->get_is_reverse(inbound) ? "-" : "+") << " on " << next_along_cycle.count(inbound) << " cycles" << endl;
 #endif
-                    
-                        if (next_along_cycle.count(inbound)) {
-                            // Put this cycle on the to do list also
-                            
+                
+                    if (next_along_cycle.count(inbound)) {
+                        // Put this cycle on the to do list also
+                        
 #ifdef debug
-                            cerr << "\t\t\tLook at cycle edge " << graph->get_id(inbound) << (graph->get_is_reverse(inbound) ? "-" : "+") << endl;
+                        cerr << "\t\t\tLook at cycle edge " << graph->get_id(inbound) << (graph->get_is_reverse(inbound) ? "-" : "+") << endl;
 #endif
-                            
-                            stack.back().todo.push_back(inbound);
-                        } else if (cactus.find(inbound) == cactus.find(graph->flip(inbound)) && !graph->get_is_reverse(inbound)) {
-                            // Self loop.
-                            // We only want them forward so each becomes only one empty chain.
-                            
+                        
+                        stack.back().todo.push_back(inbound);
+                    } else if (cactus.find(inbound) == cactus.find(graph->flip(inbound)) && !graph->get_is_reverse(inbound)) {
+                        // Self loop.
+                        // We only want them forward so each becomes only one empty chain.
+                        
 #ifdef debug
-                            cerr << "\t\t\tContain edge " << graph->get_id(inbound) << (graph->get_is_reverse(inbound) ? "-" : "+") << endl;
+                        cerr << "\t\t\tContain edge " << graph->get_id(inbound) << (graph->get_is_reverse(inbound) ? "-" : "+") << endl;
 #endif
+                    
+                        begin_chain(inbound);
+                        end_chain(inbound);
                         
-                            begin_chain(inbound);
-                            end_chain(inbound);
-                            
-                            visited.insert(inbound);
-                        } 
-                    });
-                }
+                        visited.insert(inbound);
+                    } 
+                });
             }
-            
-            longest_paths.pop_back();
         } else {
-            // We will root on a cycle for its component, if not already covered.
+            // We will root on a cycle for its component.
+            auto& longest_cycle = longest_cycles[root.second];
             
-            if (!visited.count(longest_cycles.back().second)) {
-                // This connected component hasn't been done yet.
-                
 #ifdef debug
-                cerr << "Rooting component at cycle for " << graph->get_id(longest_cycles.back().second) << endl;
+            cerr << "Longest cycle: " << longest_cycle.first << " bp" << endl;
 #endif
             
-                // We have an edge on the longest cycle. But it may be reading into and out of nodes that also contains other cycles, bridge edges, and so on.
-                // If we declare this longest cycle to be a chain, we need to make sure that both those nodes become snarls in a chain.
-                // So we introduce a chain that starts and ends with this edge.
-                // We can't quite articulate that as a todo list entry, so we forge two stack frames.
+#ifdef debug
+            cerr << "Rooting component at cycle for " << graph->get_id(longest_cycle.second) << endl;
+#endif
+        
+            // We have an edge on the longest cycle. But it may be reading into and out of nodes that also contains other cycles, bridge edges, and so on.
+            // If we declare this longest cycle to be a chain, we need to make sure that both those nodes become snarls in a chain.
+            // So we introduce a chain that starts and ends with this edge.
+            // We can't quite articulate that as a todo list entry, so we forge two stack frames.
+        
+            // Stack up a root/null snarl containing this cycle as a chain.
+            stack.emplace_back();
+            stack.back().is_snarl = true;
             
-                // Stack up a root/null snarl containing this cycle as a chain.
-                stack.emplace_back();
-                stack.back().is_snarl = true;
-                
-                // Stack up a frame for doing the chain, with the cycle-closing edge as both ends.
-                stack.emplace_back();
-                stack.back().is_snarl = false;
-                stack.back().bounds = make_pair(longest_cycles.back().second, longest_cycles.back().second);
-                
-                // We'll find all the self edges OK when we look in the first/last snarls on the chain.
-            }
+            // Stack up a frame for doing the chain, with the cycle-closing edge as both ends.
+            stack.emplace_back();
+            stack.back().is_snarl = false;
+            stack.back().bounds = make_pair(longest_cycle.second, longest_cycle.second);
             
-            longest_cycles.pop_back();
+            // We'll find all the self edges OK when we look in the first/last snarls on the chain.
         }
         
         while (!stack.empty()) {
@@ -1575,7 +2183,7 @@ void IntegratedSnarlFinder::traverse_computed_decomposition(MergedAdjacencyGraph
                 if (frame.is_snarl) {
                     // May have a bridge edge or a cycle edge, both inbound.
                     auto next_along_cycle_it = next_along_cycle.find(task);
-                    if (next_along_cycle_it != next_along_cycle.end()) {
+                    if (next_along_cycle_it != nullptr) {
                         // To handle a cycle in the current snarl
                         
 #ifdef debug
@@ -1583,7 +2191,7 @@ void IntegratedSnarlFinder::traverse_computed_decomposition(MergedAdjacencyGraph
 #endif
                         
                         // We have the incoming edge, so find the outgoing edge along the same cycle
-                        handle_t outgoing = next_along_cycle_it->second;
+                        handle_t outgoing = *next_along_cycle_it;
                         
 #ifdef debug
                         cerr << "\t\tEnds chain starting at " << graph->get_id(outgoing) << (graph->get_is_reverse(outgoing) ? "-" : "+") << endl;
@@ -1623,13 +2231,13 @@ void IntegratedSnarlFinder::traverse_computed_decomposition(MergedAdjacencyGraph
                         handle_t cactus_head = cactus.find(edge);
                         // And track where its bridge forest component points to as towards the deepest leaf.
                         auto deepest_it = towards_deepest_leaf.find(forest.find(cactus_head));
-                        while (deepest_it != towards_deepest_leaf.end()) {
+                        while (deepest_it != nullptr) {
                             // Follow its path down bridge graph heads, to the
                             // deepest bridge graph leaf head (which has no
                             // deeper child)
                             
                             // See what our next bridge edge comes out of in the Cactus graph
-                            handle_t next_back_head = cactus.find(graph->flip(deepest_it->second));
+                            handle_t next_back_head = cactus.find(graph->flip(*deepest_it));
                             
 #ifdef debug
                             cerr << "\t\t\tHead: " << graph->get_id(cactus_head) << (graph->get_is_reverse(cactus_head) ? "-" : "+") << endl;
@@ -1648,7 +2256,7 @@ void IntegratedSnarlFinder::traverse_computed_decomposition(MergedAdjacencyGraph
                                 cerr << "\t\t\tFind skipped cycle path" << endl;
 #endif
                                 
-                                vector<handle_t> cycle_path = cactus.find_cycle_path_in_cactus(next_along_cycle, cactus_head, next_back_head);
+                                vector<pair<handle_t, handle_t>> cycle_path = cactus.find_cycle_path_in_cactus(next_along_cycle, cactus_head, next_back_head);
                                 
                                 while (!cycle_path.empty()) {
                                     // Now pop stuff off the end of the path and
@@ -1656,52 +2264,49 @@ void IntegratedSnarlFinder::traverse_computed_decomposition(MergedAdjacencyGraph
                                     // is in, making sure to pinch off the cycles
                                     // we cut as we do it.
                                     
-                                    // Walk the cycle (again) to find where it hits the end component.
-                                    // TODO: Save the first traversal we did!
-                                    auto through_path_member = next_along_cycle.find(cycle_path.back());
-                                    auto through_end = through_path_member;
-                                    do {
-                                        // Follow the cycle until we reach the edge going into the end component.
-                                        through_end = next_along_cycle.find(through_end->second);
-                                    } while (cactus.find(through_end->first) != cactus.find(next_back_head));
+                                    // The path search already found where
+                                    // the cycle hits the end component,
+                                    // which now includes anything we merged
+                                    // from later on the path.
+                                    handle_t through_path_member = cycle_path.back().first;
+                                    handle_t through_end = cycle_path.back().second;
+                                    assert(cactus.find(through_end) == cactus.find(next_back_head));
                                     
                                     // Now pinch the cycle
                                     
 #ifdef debug
-                                    cerr << "\t\t\tPinch cycle between " << graph->get_id(cycle_path.back()) << (graph->get_is_reverse(cycle_path.back()) ? "-" : "+")
-                                        << " and " << graph->get_id(through_end->first) << (graph->get_is_reverse(through_end->first) ? "-" : "+") << endl;
+                                    cerr << "\t\t\tPinch cycle between " << graph->get_id(through_path_member) << (graph->get_is_reverse(through_path_member) ? "-" : "+")
+                                        << " and " << graph->get_id(through_end) << (graph->get_is_reverse(through_end) ? "-" : "+") << endl;
 #endif
                                     
                                     // Merge the two components where the bridge edges attach, to close the two new cycles.
-                                    cactus.merge(cycle_path.back(), next_back_head);
+                                    cactus.merge(through_path_member, next_back_head);
                                     
 #ifdef debug
-                                    cerr << "\t\t\t\tExchange successors of " << graph->get_id(through_path_member->first) << (graph->get_is_reverse(through_path_member->first) ? "-" : "+")
-                                        << " and " << graph->get_id(through_end->first) << (graph->get_is_reverse(through_end->first) ? "-" : "+") << endl;
+                                    cerr << "\t\t\t\tExchange successors of " << graph->get_id(through_path_member) << (graph->get_is_reverse(through_path_member) ? "-" : "+")
+                                        << " and " << graph->get_id(through_end) << (graph->get_is_reverse(through_end) ? "-" : "+") << endl;
 #endif
                                     
                                     // Exchange their destinations to pinch the cycle in two.
-                                    std::swap(through_path_member->second, through_end->second);
+                                    std::swap(next_along_cycle[through_path_member], next_along_cycle[through_end]);
                                     
-                                    if (through_path_member->first == through_path_member->second) {
+                                    if (through_path_member == next_along_cycle.at(through_path_member)) {
                                         // Now a self loop cycle. Delete the cycle.
                                         
 #ifdef debug
-                                        cerr << "\t\t\t\t\tDelete self loop cycle " << graph->get_id(through_path_member->first) << (graph->get_is_reverse(through_path_member->first) ? "-" : "+") << endl;
+                                        cerr << "\t\t\t\t\tDelete self loop cycle " << graph->get_id(through_path_member) << (graph->get_is_reverse(through_path_member) ? "-" : "+") << endl;
 #endif
                                         
-                                        // Won't affect other iterators.
                                         next_along_cycle.erase(through_path_member);
                                     }
                                     
-                                    if (through_end->first == through_end->second) {
+                                    if (through_end == next_along_cycle.at(through_end)) {
                                         // Now a self loop cycle. Delete the cycle.
                                         
 #ifdef debug
-                                        cerr << "\t\t\t\t\tDelete self loop cycle " << graph->get_id(through_end->first) << (graph->get_is_reverse(through_end->first) ? "-" : "+") << endl;
+                                        cerr << "\t\t\t\t\tDelete self loop cycle " << graph->get_id(through_end) << (graph->get_is_reverse(through_end) ? "-" : "+") << endl;
 #endif
                                         
-                                        // Won't affect other iterators.
                                         next_along_cycle.erase(through_end);
                                     }
                                     
@@ -1711,10 +2316,10 @@ void IntegratedSnarlFinder::traverse_computed_decomposition(MergedAdjacencyGraph
                             }
                             
                             // Record the new cycle we are making from this bridge path
-                            next_along_cycle[edge] = deepest_it->second;
+                            next_along_cycle[edge] = *deepest_it;
                             
                             // Advance along the bridge tree path.
-                            edge = deepest_it->second;
+                            edge = *deepest_it;
 #ifdef debug
                             cerr << "\t\tWalk edge " << graph->get_id(edge) << (graph->get_is_reverse(edge) ? "-" : "+") << endl;
 #endif
@@ -1834,9 +2439,79 @@ void IntegratedSnarlFinder::traverse_computed_decomposition(MergedAdjacencyGraph
             }
             
             
+        }
+    };
+    
+    if (roots.size() == 1) {
+        // Just do the one component directly.
+        decompose_root(roots.front(), begin_chain, end_chain, begin_snarl, end_snarl);
+    } else {
+        // Do the components in parallel, buffering their events, and report
+        // each component's events in root order.
+        enum : uint8_t {BEGIN_CHAIN, END_CHAIN, BEGIN_SNARL, END_SNARL};
+        
+        // Exceptions can't leave a parallel loop, so we catch them for each
+        // component and rethrow the first one, in root order, afterwards.
+        exception_ptr error;
+        
+#pragma omp parallel for ordered schedule(dynamic, 1)
+        for (size_t i = 0; i < roots.size(); i++) {
+            vector<pair<uint8_t, handle_t>> events;
+            exception_ptr root_error;
+            try {
+                decompose_root(roots[i], [&](handle_t here) {
+                    events.emplace_back(BEGIN_CHAIN, here);
+                }, [&](handle_t here) {
+                    events.emplace_back(END_CHAIN, here);
+                }, [&](handle_t here) {
+                    events.emplace_back(BEGIN_SNARL, here);
+                }, [&](handle_t here) {
+                    events.emplace_back(END_SNARL, here);
+                });
+            } catch (...) {
+                root_error = current_exception();
+            }
+            
+#pragma omp ordered
+            {
+                if (!error) {
+                    // Nothing before us failed, so report what we found
+                    // before any failure of our own, like the serial
+                    // decomposition would have.
+                    try {
+                        for (auto& event : events) {
+                            switch (event.first) {
+                            case BEGIN_CHAIN:
+                                begin_chain(event.second);
+                                break;
+                            case END_CHAIN:
+                                end_chain(event.second);
+                                break;
+                            case BEGIN_SNARL:
+                                begin_snarl(event.second);
+                                break;
+                            case END_SNARL:
+                                end_snarl(event.second);
+                                break;
+                            }
+                        }
+                    } catch (...) {
+                        error = current_exception();
+                    }
+                    if (!error) {
+                        error = root_error;
+                    }
+                }
+            }
+        }
+        
+        if (error) {
+            rethrow_exception(error);
         }
     }
     
+    // Every node should have found a place in the decomposition.
+    assert(visited.size() == graph->get_node_count());
 }
 
 SnarlManager IntegratedSnarlFinder::find_snarls_parallel() {
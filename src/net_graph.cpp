@@ -94,74 +94,76 @@ void NetGraph::add_chain_child(const Chain& chain) {
 #endif
         
     if (use_internal_connectivity) {
+        // Save the connectivity
+        connectivity[graph->get_id(chain_start_handle)] = chain_connectivity(chain);
+    } else {
+        // Act like a normal connected-through node.
+        connectivity[graph->get_id(chain_start_handle)] = make_tuple(false, false, true);
+    }
+}
+
+tuple<bool, bool, bool> NetGraph::chain_connectivity(const Chain& chain) {
+    // Determine child snarl connectivity.
+    bool connected_left_left = false;
+    bool connected_right_right = false;
+    bool connected_left_right = true;
         
-        // Determine child snarl connectivity.
-        bool connected_left_left = false;
-        bool connected_right_right = false;
-        bool connected_left_right = true;
-            
-        for (auto it = chain_begin(chain); it != chain_end(chain); ++it) {
-            // Go through the oriented child snarls from left to right
-            const Snarl* child = it->first;
-            bool backward = it->second;
-                
-            // Unpack the child's connectivity
-            bool start_self_reachable = child->start_self_reachable();
-            bool end_self_reachable = child->end_self_reachable();
-            bool start_end_reachable = child->start_end_reachable();
-                
-            if (backward) {
-                // Look at the connectivity in reverse
-                std::swap(start_self_reachable, end_self_reachable);
-            }
-                
-            if (start_self_reachable) {
-                // We found a turnaround from the left
-                connected_left_left = true;
-            }
-                
-            if (!start_end_reachable) {
-                // There's an impediment to getting through.
-                connected_left_right = false;
-                // Don't keep looking for turnarounds
-                break;
-            }
+    for (auto it = chain_begin(chain); it != chain_end(chain); ++it) {
+        // Go through the oriented child snarls from left to right
+        const Snarl* child = it->first;
+        bool backward = it->second;
+            
+        // Unpack the child's connectivity
+        bool start_self_reachable = child->start_self_reachable();
+        bool end_self_reachable = child->end_self_reachable();
+        bool start_end_reachable = child->start_end_reachable();
+            
+        if (backward) {
+            // Look at the connectivity in reverse
+            std::swap(start_self_reachable, end_self_reachable);
         }
             
-        for (auto it = chain_rbegin(chain); it != chain_rend(chain); ++it) {
-            // Go through the oriented child snarls from left to right
-            const Snarl* child = it->first;
-            bool backward = it->second;
-                
-            // Unpack the child's connectivity
-            bool start_self_reachable = child->start_self_reachable();
-            bool end_self_reachable = child->end_self_reachable();
-            bool start_end_reachable = child->start_end_reachable();
-                
-            if (backward) {
-                // Look at the connectivity in reverse
-                std::swap(start_self_reachable, end_self_reachable);
-            }
-                
-            if (end_self_reachable) {
-                // We found a turnaround from the right
-                connected_right_right = true;
-                break;
-            }
-                
-            if (!start_end_reachable) {
-                // Don't keep looking for turnarounds
-                break;
-            }
+        if (start_self_reachable) {
+            // We found a turnaround from the left
+            connected_left_left = true;
         }
             
-        // Save the connectivity
-        connectivity[graph->get_id(chain_start_handle)] = tie(connected_left_left,
-                                                              connected_right_right, connected_left_right);
-    } else {
-        // Act like a normal connected-through node.
-        connectivity[graph->get_id(chain_start_handle)] = make_tuple(false, false, true);
+        if (!start_end_reachable) {
+            // There's an impediment to getting through.
+            connected_left_right = false;
+            // Don't keep looking for turnarounds
+            break;
+        }
     }
+        
+    for (auto it = chain_rbegin(chain); it != chain_rend(chain); ++it) {
+        // Go through the oriented child snarls from left to right
+        const Snarl* child = it->first;
+        bool backward = it->second;
+            
+        // Unpack the child's connectivity
+        bool start_self_reachable = child->start_self_reachable();
+        bool end_self_reachable = child->end_self_reachable();
+        bool start_end_reachable = child->start_end_reachable();
+            
+        if (backward) {
+            // Look at the connectivity in reverse
+            std::swap(start_self_reachable, end_self_reachable);
+        }
+            
+        if (end_self_reachable) {
+            // We found a turnaround from the right
+            connected_right_right = true;
+            break;
+        }
+            
+        if (!start_end_reachable) {
+            // Don't keep looking for turnarounds
+            break;
+        }
+    }
+    
+    return make_tuple(connected_left_left, connected_right_right, connected_left_right);
 }
 
 bool NetGraph::has_node(nid_t node_id) const {
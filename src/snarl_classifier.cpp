@@ -0,0 +1,250 @@
+#include "snarls/snarl_classifier.hpp"
+#include "devirtualized_graph.hpp"
+
+#include <cassert>
+#include <iostream>
+
+//#define debug
+
+namespace snarls {
+
+using namespace std;
+using namespace vg;
+using namespace handlegraph;
+
+SnarlClassifier::SnarlClassifier(const HandleGraph* graph) : graph(graph) {
+    // Nothing to do!
+}
+
+void SnarlClassifier::add_chain_child(const Chain& chain) {
+    auto start_visit = get_start_of(chain);
+
+    bool connected_left_left;
+    bool connected_right_right;
+    bool connected_left_right;
+    tie(connected_left_left, connected_right_right, connected_left_right) = NetGraph::chain_connectivity(chain);
+
+    // Reading the chain forward, we can go through, or turn around at the
+    // left. Reading it backward, we can go through or turn around at the
+    // right.
+    uint8_t through = connected_left_right ? THROUGH : 0;
+    children.push_back({graph->get_handle(start_visit.node_id(), start_visit.backward()),
+                        (uint8_t) (through | (connected_left_left ? TURN : 0)),
+                        (uint8_t) (through | (connected_right_right ? TURN : 0))});
+}
+
+void SnarlClassifier::add_unary_child(const Snarl* unary) {
+    // Reading into a unary snarl, we can only ever come back out, and only
+    // if there's any connectivity inside it. Reading out of it, we can't go
+    // anywhere.
+    bool any_connectivity = unary->start_self_reachable() || unary->end_self_reachable() || unary->start_end_reachable();
+    children.push_back({graph->get_handle(unary->start().node_id(), unary->start().backward()),
+                        (uint8_t) (any_connectivity ? TURN : 0), (uint8_t) 0});
+}
+
+size_t SnarlClassifier::to_local(const NetGraph& flat_net_graph, const handle_t& handle) const {
+    // We make all the net graphs we classify, so we know they are exactly
+    // NetGraphs and can skip the vtable.
+    DevirtualizedGraph<NetGraph> view(flat_net_graph);
+    return local_index.at(view.get_id(handle)) * 2 + view.get_is_reverse(handle);
+}
+
+void SnarlClassifier::materialize(const NetGraph& flat_net_graph) {
+    local_index.clear();
+    local_handles.clear();
+    
+    // We make all the net graphs we classify, so we know they are exactly
+    // NetGraphs and can skip the vtable for the handle accessors.
+    DevirtualizedGraph<NetGraph> view(flat_net_graph);
+
+    // Enumerate the net graph's nodes just once
+    flat_net_graph.for_each_handle([&](const handle_t& handle) {
+        local_index.emplace(view.get_id(handle), local_handles.size());
+        local_handles.push_back(view.get_is_reverse(handle) ? view.flip(handle) : handle);
+    });
+
+    size_t oriented_count = local_handles.size() * 2;
+
+    // Collect all the rightward edges from each orientation of each node.
+    // Leftward edges are rightward edges of the other orientation, flipped.
+    edge_offsets.clear();
+    edge_targets.clear();
+    edge_offsets.reserve(oriented_count + 1);
+    for (size_t oriented = 0; oriented < oriented_count; oriented++) {
+        edge_offsets.push_back(edge_targets.size());
+        handle_t here = local_handles[oriented / 2];
+        if (oriented & 1) {
+            here = view.flip(here);
+        }
+        view.follow_edges(here, false, [&](const handle_t& next) {
+            edge_targets.push_back(to_local(flat_net_graph, next));
+        });
+    }
+    edge_offsets.push_back(edge_targets.size());
+
+    // Ordinary nodes just connect through. Children do whatever their
+    // internal connectivity says.
+    connectivity.assign(oriented_count, THROUGH);
+    for (auto& child : children) {
+        auto found = local_index.find(graph->get_id(child.head));
+        assert(found != local_index.end());
+        size_t oriented = found->second * 2 + graph->get_is_reverse(child.head);
+        connectivity[oriented] = child.forward_flags;
+        connectivity[oriented ^ 1] = child.reverse_flags;
+    }
+}
+
+pair<bool, bool> SnarlClassifier::reaches(size_t from, size_t target1, size_t target2) {
+    pair<bool, bool> found(false, false);
+
+    marks.assign(connectivity.size(), 0);
+    queue.clear();
+    queue.push_back(from);
+    marks[from] = 1;
+
+    for (size_t cursor = 0; cursor < queue.size(); cursor++) {
+        size_t here = queue[cursor];
+
+        found.first |= (here == target1);
+        found.second |= (here == target2);
+        if (found.first && found.second) {
+            // No more searching needed
+            break;
+        }
+
+        // Leaving right can mean going out the right side, or going back
+        // out the left side in the other orientation.
+        for (size_t side : {here ^ 1, here}) {
+            if (!(connectivity[here] & (side == here ? THROUGH : TURN))) {
+                continue;
+            }
+            for (size_t i = edge_offsets[side]; i < edge_offsets[side + 1]; i++) {
+                size_t next = edge_targets[i];
+                if (!marks[next]) {
+                    marks[next] = 1;
+                    queue.push_back(next);
+                }
+            }
+        }
+    }
+
+    return found;
+}
+
+bool SnarlClassifier::is_directed_acyclic() {
+    // Do a DFS over the oriented nodes, looking for edges back into the
+    // stack. 0 is unvisited, 1 is on the stack, and 2 is finished.
+    marks.assign(connectivity.size(), 0);
+    for (size_t root = 0; root < marks.size(); root++) {
+        if (marks[root]) {
+            continue;
+        }
+        marks[root] = 1;
+        stack.emplace_back(root, edge_offsets[root]);
+        while (!stack.empty()) {
+            size_t here = stack.back().first;
+            size_t edge = stack.back().second;
+            if (edge < edge_offsets[here + 1]) {
+                stack.back().second++;
+                size_t next = edge_targets[edge];
+                if (marks[next] == 1) {
+                    // Found a cycle
+                    stack.clear();
+                    return false;
+                } else if (marks[next] == 0) {
+                    marks[next] = 1;
+                    stack.emplace_back(next, edge_offsets[next]);
+                }
+            } else {
+                marks[here] = 2;
+                stack.pop_back();
+            }
+        }
+    }
+    return true;
+}
+
+void SnarlClassifier::classify_net_graph(Snarl& snarl, const NetGraph& flat_net_graph, bool all_ultrabubble_children) {
+
+    materialize(flat_net_graph);
+
+    /////
+    // Determine connectivity
+    /////
+
+    // A snarl is minimal, so we know out start and end will be normal nodes.
+    size_t start = to_local(flat_net_graph, flat_net_graph.get_handle(snarl.start().node_id(), snarl.start().backward()));
+    size_t end = to_local(flat_net_graph, flat_net_graph.get_handle(snarl.end().node_id(), snarl.end().backward()));
+
+    // Search from the start to see if it reaches the end, or itself the other way around.
+    bool connected_start_end;
+    bool connected_start_start;
+    tie(connected_start_end, connected_start_start) = reaches(start, end, start ^ 1);
+
+    // And search from the end inward to see if it can find itself
+    bool connected_end_end = reaches(end ^ 1, end, end).first;
+
+    snarl.set_start_self_reachable(connected_start_start);
+    snarl.set_end_self_reachable(connected_end_end);
+    snarl.set_start_end_reachable(connected_start_end);
+
+#ifdef debug
+    cerr << "Connectivity: " << connected_start_start << " " << connected_end_end << " " << connected_start_end << endl;
+#endif
+
+    /////
+    // Determine tip presence
+    /////
+
+    // Every oriented node with nothing to its right is a tip.
+    size_t tips = 0;
+    for (size_t oriented = 0; oriented + 1 < edge_offsets.size(); oriented++) {
+        if (edge_offsets[oriented] == edge_offsets[oriented + 1]) {
+            tips++;
+        }
+    }
+
+    // We should have at least the bounding nodes.
+    assert(tips >= 2);
+    bool has_internal_tips = (tips > 2);
+
+    /////
+    // Determine cyclicity/acyclicity
+    /////
+
+    snarl.set_directed_acyclic_net_graph(is_directed_acyclic());
+
+    /////
+    // Determine classification
+    /////
+
+    if (snarl.start().node_id() == snarl.end().node_id()) {
+        // Snarl has the same start and end (or no start or end, in which case we don't care).
+        snarl.set_type(UNARY);
+    } else if (!snarl.start_end_reachable()) {
+        // Can't be an ultrabubble if we're not connected through.
+        snarl.set_type(UNCLASSIFIED);
+    } else if (snarl.start_self_reachable() || snarl.end_self_reachable()) {
+        // Can't be an ultrabubble if we have these cycles
+        snarl.set_type(UNCLASSIFIED);
+    } else if (!all_ultrabubble_children) {
+        // If we have non-ultrabubble children, we can't be an ultrabubble.
+        snarl.set_type(UNCLASSIFIED);
+    } else if (has_internal_tips) {
+        // If we have internal tips, we can't be an ultrabubble
+        snarl.set_type(UNCLASSIFIED);
+    } else if (!snarl.directed_acyclic_net_graph()) {
+        // If all our children are ultrabubbles but we ourselves are cyclic, we can't be an ultrabubble
+        snarl.set_type(UNCLASSIFIED);
+    } else {
+        // We have only ultrabubble children and are acyclic.
+        // We're an ultrabubble.
+        snarl.set_type(ULTRABUBBLE);
+    }
+
+#ifdef debug
+    cerr << "Snarl classified as " << snarl.type() << endl;
+#endif
+}
+
+}
@@ -0,0 +1,109 @@
+#include "snarls/snarl_file_index.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace snarls {
+
+using namespace std;
+using namespace handlegraph;
+
+// "SNARLIDX" in little-endian ASCII
+const uint64_t SnarlFileIndex::MAGIC_NUMBER = 0x5844494C52414E53ull;
+const uint64_t SnarlFileIndex::CURRENT_VERSION = 1;
+
+SnarlFileIndex::SnarlFileIndex(istream& in) {
+    deserialize(in);
+}
+
+void SnarlFileIndex::add_group(size_t chain, nid_t min_id, nid_t max_id, int64_t start_vo, int64_t past_end_vo) {
+    assert(entries.empty() || entries.back().chain <= chain);
+    entries.push_back({chain, min_id, max_id, start_vo, past_end_vo});
+    num_chains = max(num_chains, chain + 1);
+}
+
+const vector<SnarlFileIndex::Entry>& SnarlFileIndex::groups() const {
+    return entries;
+}
+
+size_t SnarlFileIndex::chain_count() const {
+    return num_chains;
+}
+
+void SnarlFileIndex::for_each_group_in_chains(const vector<size_t>& chains, const function<void(const Entry&)>& iteratee) const {
+    // Groups are sorted by chain, so we can binary search for each chain's run.
+    for (const size_t& chain : chains) {
+        auto found = lower_bound(entries.begin(), entries.end(), chain, [](const Entry& entry, size_t value) {
+            return entry.chain < value;
+        });
+        for (; found != entries.end() && found->chain == chain; ++found) {
+            iteratee(*found);
+        }
+    }
+}
+
+void SnarlFileIndex::for_each_group_overlapping(nid_t min_id, nid_t max_id, const function<void(const Entry&)>& iteratee) const {
+    // Work out which chains we need. Snarls in a chain can refer to each
+    // other's boundaries, so we need to read whole chains.
+    vector<size_t> wanted;
+    for (auto& entry : entries) {
+        if (entry.min_id <= max_id && entry.max_id >= min_id &&
+            (wanted.empty() || wanted.back() != entry.chain)) {
+            wanted.push_back(entry.chain);
+        }
+    }
+    for_each_group_in_chains(wanted, iteratee);
+}
+
+/// Write a fixed-width integer in host byte order
+template<typename Integer>
+static void write_integer(ostream& out, Integer value) {
+    out.write((const char*) &value, sizeof(value));
+}
+
+/// Read a fixed-width integer in host byte order
+template<typename Integer>
+static Integer read_integer(istream& in) {
+    Integer value;
+    in.read((char*) &value, sizeof(value));
+    if (!in) {
+        throw runtime_error("Truncated snarl file index");
+    }
+    return value;
+}
+
+void SnarlFileIndex::serialize(ostream& out) const {
+    write_integer<uint64_t>(out, MAGIC_NUMBER);
+    write_integer<uint64_t>(out, CURRENT_VERSION);
+    write_integer<uint64_t>(out, num_chains);
+    write_integer<uint64_t>(out, entries.size());
+    for (auto& entry : entries) {
+        write_integer<uint64_t>(out, entry.chain);
+        write_integer<int64_t>(out, entry.min_id);
+        write_integer<int64_t>(out, entry.max_id);
+        write_integer<int64_t>(out, entry.start_vo);
+        write_integer<int64_t>(out, entry.past_end_vo);
+    }
+}
+
+void SnarlFileIndex::deserialize(istream& in) {
+    if (read_integer<uint64_t>(in) != MAGIC_NUMBER) {
+        throw runtime_error("Not a snarl file index");
+    }
+    uint64_t version = read_integer<uint64_t>(in);
+    if (version != CURRENT_VERSION) {
+        throw runtime_error("Unsupported snarl file index version " + to_string(version));
+    }
+    num_chains = read_integer<uint64_t>(in);
+    entries.resize(read_integer<uint64_t>(in));
+    for (auto& entry : entries) {
+        entry.chain = read_integer<uint64_t>(in);
+        entry.min_id = read_integer<int64_t>(in);
+        entry.max_id = read_integer<int64_t>(in);
+        entry.start_vo = read_integer<int64_t>(in);
+        entry.past_end_vo = read_integer<int64_t>(in);
+    }
+}
+
+}
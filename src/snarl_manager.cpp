@@ -1,11 +1,16 @@
 #include "snarls/snarl_manager.hpp"
 #include "snarls/visit.hpp"
 #include "snarls/snarl.hpp"
+#include "snarls/snarl_classifier.hpp"
+#include "devirtualized_graph.hpp"
 
-#include <vg/io/protobuf_iterator.hpp>
-#include <vg/io/protobuf_emitter.hpp>
+#include <vg/io/message_iterator.hpp>
+#include <vg/io/message_emitter.hpp>
+#include <vg/io/registry.hpp>
 
 #include <list>
+#include <limits>
+#include <memory>
 
 namespace snarls {
 
@@ -13,15 +18,105 @@ using namespace std;
 using namespace vg;
 using namespace handlegraph;
 
-SnarlManager::SnarlManager(istream& in) : SnarlManager([&in](const function<void(Snarl&)>& consume_snarl) -> void {
-    // Find all the snarls in the input stream and use each of them in the callback-based constructor
-    for (vg::io::ProtobufIterator<Snarl> iter(in); iter.has_current(); iter.advance()) {
-        consume_snarl(*iter);
-    }
-}) {
+SnarlManager::SnarlManager(istream& in) {
+    vg::io::MessageIterator iter(in);
+    load_snarls(iter, -1);
+    
+    // Record the tree structure and build the other indexes
+    finish();
+}
+
+SnarlManager::SnarlManager(istream& in, const SnarlFileIndex& index, nid_t min_id, nid_t max_id) :
+    SnarlManager(in, index, [&](const function<void(const SnarlFileIndex::Entry&)>& iteratee) {
+        index.for_each_group_overlapping(min_id, max_id, iteratee);
+    }) {
     // Nothing to do!
 }
 
+SnarlManager::SnarlManager(istream& in, const SnarlFileIndex& index, const vector<size_t>& chains) :
+    SnarlManager(in, index, [&](const function<void(const SnarlFileIndex::Entry&)>& iteratee) {
+        index.for_each_group_in_chains(chains, iteratee);
+    }) {
+    // Nothing to do!
+}
+
+SnarlManager::SnarlManager(istream& in, const SnarlFileIndex& index,
+                           const function<void(const function<void(const SnarlFileIndex::Entry&)>&)>& for_each_group) {
+    
+    // Work out the runs of the file we need, merging adjacent groups
+    vector<pair<int64_t, int64_t>> runs;
+    for_each_group([&](const SnarlFileIndex::Entry& entry) {
+        if (!runs.empty() && runs.back().second == entry.start_vo) {
+            runs.back().second = entry.past_end_vo;
+        } else {
+            runs.emplace_back(entry.start_vo, entry.past_end_vo);
+        }
+    });
+    
+    if (!runs.empty()) {
+        vg::io::MessageIterator iter(in);
+        for (auto& run : runs) {
+            // Jump to each run and read it
+            if (!iter.seek_group(run.first)) {
+                throw runtime_error("Unable to seek to snarls at virtual offset " + std::to_string(run.first));
+            }
+            load_snarls(iter, run.second);
+        }
+    }
+    
+    // Record the tree structure and build the other indexes
+    finish();
+}
+
+void SnarlManager::load_snarls(vg::io::MessageIterator& iter, int64_t past_end_vo) {
+    // Pull the encoded snarls out of the stream in batches, and decode each
+    // batch in parallel straight into the master list.
+    const string& tag = vg::io::Registry::get_protobuf_tag<Snarl>();
+    
+    // How many snarls should we decode at a time?
+    const size_t BATCH_SIZE = 1 << 16;
+    
+    // Determine if we have more snarls to read
+    auto in_range = [&]() {
+        return iter.has_current() && (past_end_vo == -1 || iter.tell_group() < past_end_vo);
+    };
+    
+    vector<unique_ptr<string>> batch;
+    batch.reserve(BATCH_SIZE);
+    while (in_range()) {
+        batch.clear();
+        while (in_range() && batch.size() < BATCH_SIZE) {
+            // Take each message. Tag-only groups come through with no message.
+            auto tagged = iter.take();
+            if (tagged.second && tagged.first == tag) {
+                batch.emplace_back(std::move(tagged.second));
+            }
+        }
+        
+        // Make room for the batch
+        size_t batch_start = snarls.size();
+        snarls.resize(batch_start + batch.size());
+        
+        // Remember if anything fails to decode
+        bool failed = false;
+        
+#pragma omp parallel for
+        for (size_t i = 0; i < batch.size(); i++) {
+            SnarlRecord& rec = snarls[batch_start + i];
+            if (!unrecord(&rec)->ParseFromString(*batch[i])) {
+#pragma omp critical (failed)
+                failed = true;
+            }
+            rec.snarl_number = batch_start + i;
+            batch[i].reset();
+        }
+        
+        if (failed) {
+            throw runtime_error("Unable to decode snarl from stream");
+        }
+    }
+}
+
 SnarlManager::SnarlManager(const function<void(const function<void(Snarl&)>&)>& for_each_snarl) {
     for_each_snarl([&](Snarl& snarl) {
         // Add each snarl to us
@@ -31,26 +126,83 @@ SnarlManager::SnarlManager(const function<void(const function<void(Snarl&)>&)>&
     finish();
 }
 
-void SnarlManager::serialize(ostream& out) const {
+void SnarlManager::serialize(ostream& out, SnarlFileIndex* index) const {
     
-    vg::io::ProtobufEmitter<Snarl> emitter(out);
-    list<const Snarl*> stack;
-
-    for (const Snarl* root : top_level_snarls()) {
-        stack.push_back(root);
+    // Track which top-level chain we are writing, and the range of snarl
+    // boundary node IDs it covers, so we can index its groups. These need to
+    // outlive the emitter, which can still call its group listener when it
+    // is destroyed.
+    size_t current_chain = 0;
+    pair<nid_t, nid_t> current_range;
+    
+    // Write everything through a compressing emitter. We encode the messages
+    // ourselves, in parallel, so we only need to hand it bytes.
+    vg::io::MessageEmitter emitter(out, true);
+    const string& tag = vg::io::Registry::get_protobuf_tag<Snarl>();
+    
+    if (index != nullptr) {
+        emitter.on_group([&](const string& group_tag, int64_t start_vo, int64_t past_end_vo) {
+            index->add_group(current_chain, current_range.first, current_range.second, start_vo, past_end_vo);
+        });
+    }
+    
+    // How many top-level chains should we encode at a time?
+    const size_t BATCH_SIZE = 1024;
+    
+    // Encoded snarls for each chain in the batch, in preorder
+    vector<vector<string>> encoded;
+    // Boundary node ID range for each chain in the batch
+    vector<pair<nid_t, nid_t>> ranges;
+    
+    for (size_t batch_start = 0; batch_start < root_chains.size(); batch_start += BATCH_SIZE) {
+        size_t batch_end = min(batch_start + BATCH_SIZE, root_chains.size());
+        
+        encoded.clear();
+        encoded.resize(batch_end - batch_start);
+        ranges.assign(batch_end - batch_start, make_pair(numeric_limits<nid_t>::max(), numeric_limits<nid_t>::min()));
         
-        while (!stack.empty()) {
-            // Grab a snarl from the stack
-            const Snarl* snarl = stack.back();
-            stack.pop_back();
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = batch_start; i < batch_end; i++) {
+            vector<string>& messages = encoded[i - batch_start];
+            pair<nid_t, nid_t>& range = ranges[i - batch_start];
             
-            // Write out the snarl
-            emitter.write_copy(*root);
-
-            for (const Snarl* child_snarl : children_of(snarl)) {
-                // Stack up its children
-                stack.push_back(child_snarl);
+            // Stack up the chain's snarls so they come off in chain order
+            vector<const Snarl*> stack;
+            const Chain& chain = root_chains[i];
+            for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+                stack.push_back(it->first);
             }
+            
+            while (!stack.empty()) {
+                // Grab a snarl from the stack
+                const Snarl* snarl = stack.back();
+                stack.pop_back();
+                
+                // Encode the snarl
+                messages.emplace_back();
+                snarl->SerializeToString(&messages.back());
+                
+                for (nid_t id : {snarl->start().node_id(), snarl->end().node_id()}) {
+                    range.first = min(range.first, id);
+                    range.second = max(range.second, id);
+                }
+                
+                const vector<const Snarl*>& children = children_of(snarl);
+                for (auto it = children.rbegin(); it != children.rend(); ++it) {
+                    // Stack up its children
+                    stack.push_back(*it);
+                }
+            }
+        }
+        
+        for (size_t i = batch_start; i < batch_end; i++) {
+            // Write out each chain as its own group(s)
+            current_chain = i;
+            current_range = ranges[i - batch_start];
+            for (string& message : encoded[i - batch_start]) {
+                emitter.write(tag, std::move(message));
+            }
+            emitter.emit_group();
         }
     }
 }
@@ -163,6 +315,44 @@ NetGraph SnarlManager::net_graph_of(const Snarl* snarl, const HandleGraph* graph
     return NetGraph(snarl->start(), snarl->end(), chains_of(snarl), graph, use_internal_connectivity);
 }
     
+void SnarlManager::enable_lazy_classification(const HandleGraph* graph) {
+    lazy_classification_graph = graph;
+    classification_flags.reset(new once_flag[snarls.size()]);
+}
+
+const Snarl* SnarlManager::classified(const Snarl* snarl) const {
+    if (lazy_classification_graph == nullptr) {
+        // We aren't classifying on demand
+        return snarl;
+    }
+    
+    call_once(classification_flags[snarl_number(snarl)], [&]() {
+        // Net graphs and chain connectivity need all the children classified first
+        for (const Snarl* child : children_of(snarl)) {
+            classified(child);
+        }
+        
+        // Get a non-const version of the snarl, which is the Snarl in one of
+        // our SnarlRecords. Nobody else writes it, because we are inside its
+        // once_flag.
+        Snarl* mutable_snarl = const_cast<Snarl*>(unrecord(record(snarl)));
+        
+        // Each thread keeps a classifier, and its scratch space, between
+        // calls, and only makes a new one when it is asked about a different
+        // graph. Classifying doesn't call back into classified(), so the
+        // classifier can't be in use further up this thread's stack.
+        thread_local const HandleGraph* classifier_graph = nullptr;
+        thread_local unique_ptr<SnarlClassifier> classifier;
+        if (!classifier || classifier_graph != lazy_classification_graph) {
+            classifier.reset(new SnarlClassifier(lazy_classification_graph));
+            classifier_graph = lazy_classification_graph;
+        }
+        classifier->classify(*mutable_snarl, chains_of(snarl));
+    });
+    
+    return snarl;
+}
+    
 bool SnarlManager::is_leaf(const Snarl* snarl) const {
     return record(snarl)->children.size() == 0;
 }
@@ -434,7 +624,8 @@ void SnarlManager::finish() {
 }
 
 const Snarl* SnarlManager::into_which_snarl(int64_t id, bool reverse) const {
-    return snarl_into.count(make_pair(id, reverse)) ? snarl_into.at(make_pair(id, reverse)) : nullptr;
+    auto found = snarl_into.find(make_pair(id, reverse));
+    return found == snarl_into.end() ? nullptr : found->second;
 }
     
 const Snarl* SnarlManager::into_which_snarl(const Visit& visit) const {
@@ -490,6 +681,35 @@ void SnarlManager::build_indexes() {
     }
     
         
+    // Resolve all the parent references in parallel. Remember the first one
+    // that we can't resolve, so we can complain about it.
+    string unmanaged_parent;
+    
+#pragma omp parallel for
+    for (size_t i = 0; i < snarls.size(); i++) {
+        SnarlRecord& rec = snarls[i];
+        Snarl& snarl = *unrecord(&rec);
+        
+        rec.parent = nullptr;
+        if (snarl.has_parent()) {
+            auto found = snarl_into.find(make_pair(snarl.parent().start().node_id(), snarl.parent().start().backward()));
+            if (found == snarl_into.end()) {
+#pragma omp critical (unmanaged_parent)
+                {
+                    if (unmanaged_parent.empty()) {
+                        unmanaged_parent = to_string(snarl.parent());
+                    }
+                }
+            } else {
+                rec.parent = found->second;
+            }
+        }
+    }
+    
+    if (!unmanaged_parent.empty()) {
+        throw runtime_error("Unable to find snarl " + unmanaged_parent + " in SnarlManager");
+    }
+        
     for (SnarlRecord& rec : snarls) {
         Snarl& snarl = *unrecord(&rec);
             
@@ -498,18 +718,15 @@ void SnarlManager::build_indexes() {
 #endif
             
         // is this a top-level snarl?
-        if (snarl.has_parent()) {
+        if (rec.parent != nullptr) {
             // add this snarl to the parent-to-children index
 #ifdef debug
             cerr << "\tSnarl is a child" << endl;
 #endif
             
             // Record it as a child of its parent
-            SnarlRecord* parent = (SnarlRecord*) record(manage(snarl.parent()));
+            SnarlRecord* parent = (SnarlRecord*) record(rec.parent);
             parent->children.push_back(&snarl);
-            
-            // And that its parent is its parent
-            rec.parent = unrecord(parent);
         }
         else {
             // record top level status
@@ -517,8 +734,6 @@ void SnarlManager::build_indexes() {
             cerr << "\tSnarl is top-level" << endl;
 #endif
             roots.push_back(&snarl);
-            
-            rec.parent = nullptr;
         }
     }
         
@@ -542,7 +757,11 @@ void SnarlManager::build_indexes() {
         }
     }
     
-    for (SnarlRecord& rec : snarls) {
+    // Each snarl's child chains only touch its own children's records, so we
+    // can compute them all in parallel.
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t snarl_number = 0; snarl_number < snarls.size(); snarl_number++) {
+        SnarlRecord& rec = snarls[snarl_number];
         if (rec.children.empty()) {
             // Only look at snarls with children.
             continue;
@@ -720,8 +939,11 @@ void SnarlManager::regularize() {
     
 }
     
-pair<unordered_set<nid_t>, unordered_set<edge_t> > SnarlManager::shallow_contents(const Snarl* snarl, const HandleGraph& graph,
-                                                                                 bool include_boundary_nodes) const {
+/// Find the shallow contents of a snarl, using the given view of the graph.
+/// The view type determines whether graph accesses can be inlined.
+template<typename GraphView>
+static pair<unordered_set<nid_t>, unordered_set<edge_t> > shallow_contents_in(const SnarlManager& manager, const Snarl* snarl,
+                                                                              const GraphView& graph, bool include_boundary_nodes) {
     
     pair<unordered_set<nid_t>, unordered_set<edge_t> > to_return;
         
@@ -782,8 +1004,8 @@ pair<unordered_set<nid_t>, unordered_set<edge_t> > SnarlManager::shallow_content
         // record that this node is in the snarl
         to_return.first.insert(graph.get_id(node));
             
-        const Snarl* forward_snarl = into_which_snarl(graph.get_id(node), false);
-        const Snarl* backward_snarl = into_which_snarl(graph.get_id(node), true);
+        const Snarl* forward_snarl = manager.into_which_snarl(graph.get_id(node), false);
+        const Snarl* backward_snarl = manager.into_which_snarl(graph.get_id(node), true);
         if (forward_snarl) {
             // this node points into a snarl
                 
@@ -850,8 +1072,11 @@ pair<unordered_set<nid_t>, unordered_set<edge_t> > SnarlManager::shallow_content
     return to_return;
 }
     
-pair<unordered_set<nid_t>, unordered_set<edge_t> > SnarlManager::deep_contents(const Snarl* snarl, const HandleGraph& graph,
-                                                                              bool include_boundary_nodes) const {
+/// Find the deep contents of a snarl, using the given view of the graph.
+/// The view type determines whether graph accesses can be inlined.
+template<typename GraphView>
+static pair<unordered_set<nid_t>, unordered_set<edge_t> > deep_contents_in(const Snarl* snarl, const GraphView& graph,
+                                                                           bool include_boundary_nodes) {
         
     pair<unordered_set<nid_t>, unordered_set<edge_t> > to_return;
         
@@ -934,6 +1159,20 @@ pair<unordered_set<nid_t>, unordered_set<edge_t> > SnarlManager::deep_contents(c
     return to_return;
 }
     
+pair<unordered_set<nid_t>, unordered_set<edge_t> > SnarlManager::shallow_contents(const Snarl* snarl, const HandleGraph& graph,
+                                                                                 bool include_boundary_nodes) const {
+    return with_devirtualized_graph(graph, [&](const auto& view) {
+        return shallow_contents_in(*this, snarl, view, include_boundary_nodes);
+    });
+}
+    
+pair<unordered_set<nid_t>, unordered_set<edge_t> > SnarlManager::deep_contents(const Snarl* snarl, const HandleGraph& graph,
+                                                                              bool include_boundary_nodes) const {
+    return with_devirtualized_graph(graph, [&](const auto& view) {
+        return deep_contents_in(snarl, view, include_boundary_nodes);
+    });
+}
+    
 const Snarl* SnarlManager::manage(const Snarl& not_owned) const {
     // TODO: keep the Snarls in some kind of sorted order to make lookup
     // efficient. We could also have a map<Snarl, Snarl*> but that would be
@@ -960,123 +1199,180 @@ vector<Visit> SnarlManager::visits_right(const Visit& visit, const HandleGraph&
 #ifdef debug
     cerr << "Look right from " << visit << endl;
 #endif
+    
+    // Only the boundaries of the visited snarl are needed to look out of
+    // it, so we can work from the Visit's own copy even if it isn't managed.
+    NetVisit start;
+    if (visit.node_id() != 0) {
+        start.handle = graph.get_handle(visit.node_id(), visit.backward());
+    } else {
+        start.snarl = &visit.snarl();
+        start.backward = visit.backward();
+    }
         
     // We'll populate this
     vector<Visit> to_return;
+    
+    for_each_visit_right(start, graph, in_snarl, [&](const NetVisit& next) {
+        to_return.emplace_back(from_net_visit(next, graph));
+    });
         
-    // Find the right side of the visit we're on
-    pair<nid_t, bool> right_side = to_right_side(visit);
+    return to_return;
+        
+}
+    
+vector<Visit> SnarlManager::visits_left(const Visit& visit, const HandleGraph& graph, const Snarl* in_snarl) const {
+        
+    // Get everything right of the reversed visit
+    vector<Visit> to_return = visits_right(reverse(visit), graph, in_snarl);
         
-    if (visit.node_id() == 0) {
+    // Un-reverse them so they are in the correct orientation to be seen
+    // left of here.
+    for (auto& v : to_return) {
+        v = reverse(v);
+    }
+        
+    return to_return;
+        
+}
+
+void SnarlManager::for_each_visit_right(const NetVisit& visit, const HandleGraph& graph, const Snarl* in_snarl,
+                                        const function<void(const NetVisit&)>& iteratee) const {
+    
+    // Find the handle we leave the visit along, reading out of its right side
+    handle_t exit;
+    if (visit.snarl == nullptr) {
+        exit = visit.handle;
+    } else if (visit.backward) {
+        // Leave out the start of the snarl, backward
+        exit = graph.get_handle(visit.snarl->start().node_id(), !visit.snarl->start().backward());
+    } else {
+        // Leave out the end of the snarl
+        exit = graph.get_handle(visit.snarl->end().node_id(), visit.snarl->end().backward());
+    }
+    
+#ifdef debug
+    cerr << "Look right from " << graph.get_id(exit) << (graph.get_is_reverse(exit) ? "-" : "+") << endl;
+#endif
+    
+    if (visit.snarl != nullptr) {
         // We're leaving a child snarl, so we are going to need to check if
         // another child snarl shares this boundary node in the direction
         // we're going.
-            
-        const Snarl* child = into_which_snarl(right_side.first, !right_side.second);
+        
+        nid_t exit_id = graph.get_id(exit);
+        bool exit_reverse = graph.get_is_reverse(exit);
+        
+        const Snarl* child = into_which_snarl(exit_id, exit_reverse);
         if (child != nullptr && child != in_snarl
-            && into_which_snarl(right_side.first, right_side.second) != in_snarl) {
+            && into_which_snarl(exit_id, !exit_reverse) != in_snarl) {
             // We leave the one child and immediately enter another!
-                
-            // Make a visit to it
-            Visit child_visit;
-            transfer_boundary_info(*child, *child_visit.mutable_snarl());
-                
-            if (right_side.first == child->end().node_id()) {
+            
+            NetVisit child_visit;
+            child_visit.snarl = child;
+            
+            if (exit_id == child->end().node_id()) {
                 // We came in its end
-                child_visit.set_backward(true);
+                child_visit.backward = true;
             } else {
                 // We should have come in its start
-                assert(right_side.first == child->start().node_id());
+                assert(exit_id == child->start().node_id());
             }
-                
+            
             // Bail right now, so we don't try to explore inside this child snarl.
-            to_return.push_back(child_visit);
-            return to_return;
-                
+            iteratee(child_visit);
+            return;
         }
-            
     }
-
-    graph.follow_edges(graph.get_handle(right_side.first), !right_side.second, [&](const handle_t& next_handle) {
-        // For every NodeSide attached to the right side of this visit
-        pair<nid_t, bool> attached = make_pair(graph.get_id(next_handle), right_side.second ? graph.get_is_reverse(next_handle) : !graph.get_is_reverse(next_handle));
-            
+    
+    graph.follow_edges(exit, false, [&](const handle_t& next_handle) {
+        // For every oriented node attached to the right side of this visit
+        nid_t next_id = graph.get_id(next_handle);
+        bool next_reverse = graph.get_is_reverse(next_handle);
+        
 #ifdef debug
-        cerr << "\tFind NodeSide " << attached.first << "," << attached.second << endl;
+        cerr << "\tFind oriented node " << next_id << "," << next_reverse << endl;
 #endif
-            
-        const Snarl* child = into_which_snarl(attached.first, attached.second);
+        
+        const Snarl* child = into_which_snarl(next_id, next_reverse);
         if (child != nullptr && child != in_snarl
-            && into_which_snarl(attached.first, !attached.second) != in_snarl) {
+            && into_which_snarl(next_id, !next_reverse) != in_snarl) {
             // We're reading into a child
-                
+            
 #ifdef debug
             cerr << "\t\tGoes to Snarl " << *child << endl;
 #endif
-                
-            if (attached.first == child->start().node_id()) {
-                // We're reading into the start of the child
-                    
-                // Make a visit to the child snarl
-                Visit child_visit;
-                transfer_boundary_info(*child, *child_visit.mutable_snarl());
-                    
-#ifdef debug
-                cerr << "\t\tProduces Visit " << child_visit << endl;
-#endif
-                    
-                // Put it in in the forward orientation
-                to_return.push_back(child_visit);
-            } else if (attached.first == child->end().node_id()) {
-                // We're reading into the end of the child
-                    
-                // Make a visit to the child snarl
-                Visit child_visit;
-                transfer_boundary_info(*child, *child_visit.mutable_snarl());
-                child_visit.set_backward(true);
-                    
-#ifdef debug
-                cerr << "\t\tProduces Visit " << child_visit << endl;
-#endif
-                    
-                // Put it in in the reverse orientation
-                to_return.push_back(child_visit);
+            
+            NetVisit child_visit;
+            child_visit.snarl = child;
+            
+            if (next_id == child->start().node_id()) {
+                // We're reading into the start of the child, so put it in in
+                // the forward orientation
+            } else if (next_id == child->end().node_id()) {
+                // We're reading into the end of the child, so put it in in the
+                // reverse orientation
+                child_visit.backward = true;
             } else {
                 // Should never happen
                 throw runtime_error("Read into child " + to_string(*child) + " with non-matching traversal");
             }
+            
+            iteratee(child_visit);
         } else {
             // We just go into a normal node
-            to_return.emplace_back();
-            Visit& next_visit = to_return.back();
-            next_visit.set_node_id(attached.first);
-            next_visit.set_backward(attached.second);
-            
-#ifdef debug
-            cerr << "\t\tProduces Visit " << to_return.back() << endl;
-#endif
-                
+            NetVisit next_visit;
+            next_visit.handle = next_handle;
+            iteratee(next_visit);
         }
     });
-        
-    return to_return;
-        
 }
+
+void SnarlManager::for_each_visit_left(const NetVisit& visit, const HandleGraph& graph, const Snarl* in_snarl,
+                                       const function<void(const NetVisit&)>& iteratee) const {
     
-vector<Visit> SnarlManager::visits_left(const Visit& visit, const HandleGraph& graph, const Snarl* in_snarl) const {
-        
     // Get everything right of the reversed visit
-    vector<Visit> to_return = visits_right(reverse(visit), graph, in_snarl);
-        
-    // Un-reverse them so they are in the correct orientation to be seen
-    // left of here.
-    for (auto& v : to_return) {
-        v = reverse(v);
+    NetVisit reversed = visit;
+    if (reversed.snarl == nullptr) {
+        reversed.handle = graph.flip(reversed.handle);
+    } else {
+        reversed.backward = !reversed.backward;
+    }
+    
+    for_each_visit_right(reversed, graph, in_snarl, [&](const NetVisit& next) {
+        // Un-reverse each one so it is in the correct orientation to be seen
+        // left of here.
+        NetVisit prev = next;
+        if (prev.snarl == nullptr) {
+            prev.handle = graph.flip(prev.handle);
+        } else {
+            prev.backward = !prev.backward;
+        }
+        iteratee(prev);
+    });
+}
+
+NetVisit SnarlManager::to_net_visit(const Visit& visit, const HandleGraph& graph) const {
+    NetVisit to_return;
+    if (visit.node_id() != 0) {
+        to_return.handle = graph.get_handle(visit.node_id(), visit.backward());
+    } else {
+        to_return.snarl = manage(visit.snarl());
+        to_return.backward = visit.backward();
     }
-        
     return to_return;
-        
 }
 
+Visit SnarlManager::from_net_visit(const NetVisit& visit, const HandleGraph& graph) const {
+    Visit to_return;
+    if (visit.snarl == nullptr) {
+        to_return.set_node_id(graph.get_id(visit.handle));
+        to_return.set_backward(graph.get_is_reverse(visit.handle));
+    } else {
+        transfer_boundary_info(*visit.snarl, *to_return.mutable_snarl());
+        to_return.set_backward(visit.backward);
+    }
+    return to_return;
+}
 
 }